@@ -58,7 +58,14 @@ namespace nl {
         if (!t) {
             glGenTextures(1, &t);
             glBindTexture(GL_TEXTURE_2D, t);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, b.width(), b.height(), 0, GL_BGRA, GL_UNSIGNED_BYTE, b.data());
+            if (b.compressed() && GLEW_EXT_texture_compression_s3tc) {
+                GLenum const format = b.pixel_format() == bitmap::format::bc1 ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+                    : b.pixel_format() == bitmap::format::bc2 ? GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+                    : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+                glCompressedTexImage2D(GL_TEXTURE_2D, 0, format, b.width(), b.height(), 0, b.compressed_length(), b.compressed_data());
+            } else {
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, b.width(), b.height(), 0, GL_BGRA, GL_UNSIGNED_BYTE, b.data());
+            }
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -198,14 +205,24 @@ namespace nl {
         if (xbegin > view::width) return;
         if (yend + height < 0) return;
         if (ybegin > view::height) return;
+        bitmap b = current;
+        bitmap::rect const bounds = b.bounds();
+        //Nothing visible in the bitmap at all
+        if (bounds.right <= bounds.left || bounds.bottom <= bounds.top) return;
+        double alpha = 1;
         if (config::rave) {
         } else if (animated) {
             double dif = delay / next_delay;
-            glColor4d(1, 1, 1, dif * a1 + (1 - dif) * a0);
+            alpha = dif * a1 + (1 - dif) * a0;
+            glColor4d(1, 1, 1, alpha);
         } else {
             glColor4d(1, 1, 1, 1);
         }
         bind();
+        //Blending stays on for everything else, so it is only turned off for the draw itself
+        bool const blend = !b.opaque() || alpha < 1 || config::rave;
+        if (!blend) glDisable(GL_BLEND);
+        bool const trimmed = bounds.left > 0 || bounds.top > 0 || bounds.right < width || bounds.bottom < height;
         if (f & tilex && cx == width) {
             if (f & tiley && cy == height) {
                 xend += cx;
@@ -262,8 +279,27 @@ namespace nl {
             glRotated(angle, 0, 0, 1);
             glTranslated(f & flipped ? width - originx : -originx, -originy, 0);
             glScaled(f & flipped ? -width : width, height, 1);
-            glDrawArrays(GL_QUADS, 0, 4);
+            if (trimmed) {
+                //Only cover the part of the bitmap that isn't fully transparent
+                double const l = static_cast<double>(bounds.left) / width;
+                double const t = static_cast<double>(bounds.top) / height;
+                double const r = static_cast<double>(bounds.right) / width;
+                double const d = static_cast<double>(bounds.bottom) / height;
+                glBegin(GL_QUADS);
+                glTexCoord2d(l, t);
+                glVertex2d(l, t);
+                glTexCoord2d(r, t);
+                glVertex2d(r, t);
+                glTexCoord2d(r, d);
+                glVertex2d(r, d);
+                glTexCoord2d(l, d);
+                glVertex2d(l, d);
+                glEnd();
+            } else {
+                glDrawArrays(GL_QUADS, 0, 4);
+            }
         }
+        if (!blend) glEnable(GL_BLEND);
         /*
         if (tilex) {
             if (tiley) {
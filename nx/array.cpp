@@ -0,0 +1,43 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNx - Part of the NoLifeStory project                               //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#include "array.hpp"
+
+namespace nl {
+    array::operator bool() const {
+        return m_data ? true : false;
+    }
+    array::kind array::element_kind() const {
+        return m_kind;
+    }
+    size_t array::size() const {
+        return m_size;
+    }
+    span<int64_t> array::integers() const {
+        if (m_kind != kind::integer) return {};
+        return {reinterpret_cast<int64_t const *>(m_data), m_size};
+    }
+    span<double> array::reals() const {
+        if (m_kind != kind::real) return {};
+        return {reinterpret_cast<double const *>(m_data), m_size};
+    }
+    span<array::point> array::vectors() const {
+        if (m_kind != kind::vector) return {};
+        return {reinterpret_cast<point const *>(m_data), m_size};
+    }
+}
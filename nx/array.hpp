@@ -0,0 +1,80 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNx - Part of the NoLifeStory project                               //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+namespace nl {
+    //A read only view of count elements of T
+    template <typename T> class span {
+    public:
+        span() : m_data {nullptr}, m_size {0} {}
+        span(T const * d, size_t s) : m_data {d}, m_size {s} {}
+        T const * begin() const {
+            return m_data;
+        }
+        T const * end() const {
+            return m_data + m_size;
+        }
+        T const & operator[](size_t i) const {
+            return m_data[i];
+        }
+        T const * data() const {
+            return m_data;
+        }
+        size_t size() const {
+            return m_size;
+        }
+        bool empty() const {
+            return !m_size;
+        }
+    private:
+        T const * m_data;
+        size_t m_size;
+    };
+    //The children of a node named 0, 1, 2... that all hold the same kind of number,
+    //such as the points of a Convex2D, packed together by the converter
+    //The children are still there, so older readers and child lookups see the same nodes as before
+    class array {
+    public:
+        //The type of every element, using the same values as node::type
+        enum class kind : uint8_t {
+            integer = 1,
+            real = 2,
+            vector = 4,
+        };
+        struct point {
+            int32_t x, y;
+        };
+        //Returns whether the array is valid or merely null
+        explicit operator bool() const;
+        kind element_kind() const;
+        size_t size() const;
+        //Each of these is empty unless the elements are of that kind
+        //The pointers remain valid until the file this array is part of is destroyed
+        span<int64_t> integers() const;
+        span<double> reals() const;
+        span<point> vectors() const;
+        //Internal variables
+        //They are only public so that the class may be Plain Old Data
+        void const * m_data;
+        uint32_t m_size;
+        kind m_kind;
+    };
+}
@@ -17,6 +17,7 @@
 //////////////////////////////////////////////////////////////////////////////
 
 #include "audio.hpp"
+#include "file.hpp"
 
 namespace nl {
     bool audio::operator<(audio const & o) const {
@@ -34,6 +35,32 @@ namespace nl {
     uint32_t audio::length() const {
         return m_length;
     }
+    bool audio::has_info() const {
+        return m_data && m_file->m_audio_info;
+    }
+    audio::codec audio::payload_codec() const {
+        return has_info() ? static_cast<codec>(m_file->m_audio_info[m_index].codec) : codec::unknown;
+    }
+    uint32_t audio::sample_rate() const {
+        return has_info() ? m_file->m_audio_info[m_index].sample_rate : 0;
+    }
+    uint16_t audio::channels() const {
+        return has_info() ? m_file->m_audio_info[m_index].channels : 0;
+    }
+    uint16_t audio::bits_per_sample() const {
+        return has_info() ? m_file->m_audio_info[m_index].bits_per_sample : 0;
+    }
+    uint32_t audio::duration() const {
+        return has_info() ? m_file->m_audio_info[m_index].duration : 0;
+    }
+    void const * audio::sound_data() const {
+        if (!has_info()) return m_data;
+        return reinterpret_cast<char const *>(m_data) + m_file->m_audio_info[m_index].header_length;
+    }
+    uint32_t audio::sound_length() const {
+        if (!has_info()) return m_length;
+        return m_length - m_file->m_audio_info[m_index].header_length;
+    }
     size_t audio::id() const {
         return reinterpret_cast<size_t>(m_data);
     }
@@ -21,8 +21,15 @@
 #include <cstddef>
 
 namespace nl {
+    class file;
     class audio {
     public:
+        //How the sound data following the header is encoded
+        enum class codec : uint8_t {
+            unknown = 0,
+            pcm = 1,
+            mp3 = 2,
+        };
         //Comparison operators, useful for containers
         bool operator==(audio const &) const;
         bool operator<(audio const &)const;
@@ -33,12 +40,29 @@ namespace nl {
         //The pointer remains valid until the file this audio is part of is destroyed
         void const * data() const;
         uint32_t length() const;
+        //Format metadata, only available if the converter stored it in the file
+        //Without it the codec is unknown and the other values are 0
+        bool has_info() const;
+        codec payload_codec() const;
+        uint32_t sample_rate() const;
+        uint16_t channels() const;
+        //Only meaningful for PCM
+        uint16_t bits_per_sample() const;
+        //In milliseconds
+        uint32_t duration() const;
+        //The encoded sound itself, past the Sound_DX8 header that data() includes
+        //PCM can be played directly from this pointer as interleaved little endian samples
+        //Without format metadata this is the same as data() and length()
+        void const * sound_data() const;
+        uint32_t sound_length() const;
         //Returns a unique id, useful for keeping track of what audio you loaded
         size_t id() const;
         //Internal variables
         //They are only public so that the class may be Plain Old Data
         void const * m_data;
         uint32_t m_length;
+        file const * m_file;
+        uint32_t m_index;
     private:
         friend class node;
     };
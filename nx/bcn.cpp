@@ -0,0 +1,258 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNx - Part of the NoLifeStory project                               //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#include "bcn.hpp"
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+
+namespace bcn {
+    struct color {
+        uint8_t b, g, r, a;
+    };
+    size_t length(uint16_t width, uint16_t height, size_t block_size) {
+        return ((width + 3u) >> 2) * ((height + 3u) >> 2) * block_size;
+    }
+    color unpack565(uint16_t c) {
+        uint8_t const r {static_cast<uint8_t>(c >> 11 & 0x1f)};
+        uint8_t const g {static_cast<uint8_t>(c >> 5 & 0x3f)};
+        uint8_t const b {static_cast<uint8_t>(c & 0x1f)};
+        return {static_cast<uint8_t>(b << 3 | b >> 2), static_cast<uint8_t>(g << 2 | g >> 4), static_cast<uint8_t>(r << 3 | r >> 2), 255};
+    }
+    uint16_t pack565(float r, float g, float b) {
+        auto clamp = [](float v, int max) {
+            int const i {static_cast<int>(v * max / 255.f + .5f)};
+            return i < 0 ? 0 : i > max ? max : i;
+        };
+        return static_cast<uint16_t>(clamp(r, 31) << 11 | clamp(g, 63) << 5 | clamp(b, 31));
+    }
+    color mix(color const & c0, color const & c1, int w0, int w1) {
+        int const d {w0 + w1};
+        return {static_cast<uint8_t>((c0.b * w0 + c1.b * w1) / d), static_cast<uint8_t>((c0.g * w0 + c1.g * w1) / d),
+            static_cast<uint8_t>((c0.r * w0 + c1.r * w1) / d), 255};
+    }
+    void color_palette(uint16_t c0, uint16_t c1, bool punchthrough, color (&p)[4]) {
+        p[0] = unpack565(c0);
+        p[1] = unpack565(c1);
+        if (c0 > c1 || !punchthrough) {
+            p[2] = mix(p[0], p[1], 2, 1);
+            p[3] = mix(p[0], p[1], 1, 2);
+        } else {
+            p[2] = mix(p[0], p[1], 1, 1);
+            p[3] = {0, 0, 0, 0};
+        }
+    }
+    void alpha_palette(uint8_t a0, uint8_t a1, uint8_t (&p)[8]) {
+        p[0] = a0;
+        p[1] = a1;
+        if (a0 > a1) {
+            for (int i {1}; i < 7; ++i) p[i + 1] = static_cast<uint8_t>(((7 - i) * a0 + i * a1) / 7);
+        } else {
+            for (int i {1}; i < 5; ++i) p[i + 1] = static_cast<uint8_t>(((5 - i) * a0 + i * a1) / 5);
+            p[6] = 0;
+            p[7] = 255;
+        }
+    }
+    uint16_t read16(uint8_t const * p) {
+        return static_cast<uint16_t>(p[0] | p[1] << 8);
+    }
+    uint32_t read32(uint8_t const * p) {
+        return static_cast<uint32_t>(read16(p) | read16(p + 2) << 16);
+    }
+    void write16(uint8_t * p, uint16_t v) {
+        p[0] = static_cast<uint8_t>(v);
+        p[1] = static_cast<uint8_t>(v >> 8);
+    }
+    void write32(uint8_t * p, uint32_t v) {
+        write16(p, static_cast<uint16_t>(v));
+        write16(p + 2, static_cast<uint16_t>(v >> 16));
+    }
+    //Decoding
+    void decode_color(uint8_t const * s, bool punchthrough, color (&block)[16]) {
+        color p[4];
+        color_palette(read16(s), read16(s + 2), punchthrough, p);
+        uint32_t const indices {read32(s + 4)};
+        for (int i {0}; i < 16; ++i) block[i] = p[indices >> (i * 2) & 3];
+    }
+    void decode_explicit_alpha(uint8_t const * s, color (&block)[16]) {
+        for (int i {0}; i < 16; ++i) block[i].a = static_cast<uint8_t>((s[i >> 1] >> ((i & 1) * 4) & 0xf) * 17);
+    }
+    void decode_interpolated_alpha(uint8_t const * s, color (&block)[16]) {
+        uint8_t p[8];
+        alpha_palette(s[0], s[1], p);
+        uint64_t indices {0};
+        for (int i {5}; i >= 0; --i) indices = indices << 8 | s[i + 2];
+        for (int i {0}; i < 16; ++i) block[i].a = p[indices >> (i * 3) & 7];
+    }
+    void store_block(color const (&block)[16], uint8_t * dest, uint16_t width, uint16_t height, unsigned x, unsigned y) {
+        for (unsigned by {0}; by < 4 && y + by < height; ++by) {
+            unsigned const n {x + 4 <= width ? 4 : width - x};
+            std::memcpy(dest + ((y + by) * width + x) * 4, block + by * 4, n * 4);
+        }
+    }
+    template <typename F> void decompress(void const * source, void * dest, uint16_t width, uint16_t height, size_t block_size, F decode) {
+        uint8_t const * s {reinterpret_cast<uint8_t const *>(source)};
+        uint8_t * const d {reinterpret_cast<uint8_t *>(dest)};
+        color block[16];
+        for (unsigned y {0}; y < height; y += 4) for (unsigned x {0}; x < width; x += 4, s += block_size) {
+            decode(s, block);
+            store_block(block, d, width, height, x, y);
+        }
+    }
+    void decompress_bc1(void const * source, void * dest, uint16_t width, uint16_t height) {
+        decompress(source, dest, width, height, 8, [](uint8_t const * s, color (&block)[16]) {
+            decode_color(s, true, block);
+        });
+    }
+    void decompress_bc2(void const * source, void * dest, uint16_t width, uint16_t height) {
+        decompress(source, dest, width, height, 16, [](uint8_t const * s, color (&block)[16]) {
+            decode_color(s + 8, false, block);
+            decode_explicit_alpha(s, block);
+        });
+    }
+    void decompress_bc3(void const * source, void * dest, uint16_t width, uint16_t height) {
+        decompress(source, dest, width, height, 16, [](uint8_t const * s, color (&block)[16]) {
+            decode_color(s + 8, false, block);
+            decode_interpolated_alpha(s, block);
+        });
+    }
+    //Encoding
+    void load_block(uint8_t const * source, uint16_t width, uint16_t height, unsigned x, unsigned y, color (&block)[16]) {
+        //Pixels past the edge repeat the last row or column so they don't skew the endpoints
+        for (unsigned by {0}; by < 4; ++by) for (unsigned bx {0}; bx < 4; ++bx) {
+            unsigned const px {x + bx < width ? x + bx : width - 1u};
+            unsigned const py {y + by < height ? y + by : height - 1u};
+            std::memcpy(&block[by * 4 + bx], source + (py * width + px) * 4, 4);
+        }
+    }
+    int distance(color const & c1, color const & c2) {
+        int const dr {c1.r - c2.r}, dg {c1.g - c2.g}, db {c1.b - c2.b};
+        return dr * dr + dg * dg + db * db;
+    }
+    //Picks the endpoints along the principal axis of the colors and assigns each pixel its nearest palette entry
+    void encode_color(color const (&block)[16], bool punchthrough, uint8_t * d) {
+        bool used[16];
+        bool transparent {false};
+        int count {0};
+        float mean[3] {};
+        for (int i {0}; i < 16; ++i) {
+            used[i] = !punchthrough || block[i].a >= 128;
+            if (!used[i]) {
+                transparent = true;
+                continue;
+            }
+            mean[0] += block[i].r, mean[1] += block[i].g, mean[2] += block[i].b;
+            ++count;
+        }
+        if (!count) {
+            write16(d, 0);
+            write16(d + 2, 0);
+            write32(d + 4, 0xffffffffu);
+            return;
+        }
+        for (float & m : mean) m /= count;
+        float cov[6] {};
+        for (int i {0}; i < 16; ++i) if (used[i]) {
+            float const r {block[i].r - mean[0]}, g {block[i].g - mean[1]}, b {block[i].b - mean[2]};
+            cov[0] += r * r, cov[1] += r * g, cov[2] += r * b;
+            cov[3] += g * g, cov[4] += g * b, cov[5] += b * b;
+        }
+        float axis[3] {1.f, 1.f, 1.f};
+        for (int n {0}; n < 8; ++n) {
+            float const r {axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2]};
+            float const g {axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4]};
+            float const b {axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5]};
+            float const m {std::fmax(std::fabs(r), std::fmax(std::fabs(g), std::fabs(b)))};
+            if (m < 1e-6f) break;
+            axis[0] = r / m, axis[1] = g / m, axis[2] = b / m;
+        }
+        float lo {0}, hi {0};
+        for (int i {0}; i < 16; ++i) if (used[i]) {
+            float const t {(block[i].r - mean[0]) * axis[0] + (block[i].g - mean[1]) * axis[1] + (block[i].b - mean[2]) * axis[2]};
+            lo = std::fmin(lo, t), hi = std::fmax(hi, t);
+        }
+        float const len {axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]};
+        if (len > 0) lo /= len, hi /= len;
+        uint16_t c0 {pack565(mean[0] + axis[0] * hi, mean[1] + axis[1] * hi, mean[2] + axis[2] * hi)};
+        uint16_t c1 {pack565(mean[0] + axis[0] * lo, mean[1] + axis[1] * lo, mean[2] + axis[2] * lo)};
+        //Four color mode needs c0 > c1 while the punchthrough mode needs c0 <= c1
+        if (transparent ? c0 > c1 : c0 < c1) std::swap(c0, c1);
+        color p[4];
+        color_palette(c0, c1, punchthrough, p);
+        //Equal endpoints put even opaque BC1 blocks in the punchthrough mode, where the last entry is transparent
+        int const entries {punchthrough && c0 <= c1 ? 3 : 4};
+        uint32_t indices {0};
+        for (int i {0}; i < 16; ++i) {
+            uint32_t best {3};
+            if (used[i]) {
+                int bestd {distance(block[i], p[0])};
+                best = 0;
+                for (int j {1}; j < entries; ++j) {
+                    int const dj {distance(block[i], p[j])};
+                    if (dj < bestd) bestd = dj, best = static_cast<uint32_t>(j);
+                }
+            }
+            indices |= best << (i * 2);
+        }
+        write16(d, c0);
+        write16(d + 2, c1);
+        write32(d + 4, indices);
+    }
+    void encode_alpha(color const (&block)[16], uint8_t * d) {
+        uint8_t lo {255}, hi {0};
+        for (color const & c : block) {
+            if (c.a < lo) lo = c.a;
+            if (c.a > hi) hi = c.a;
+        }
+        uint8_t p[8];
+        alpha_palette(hi, lo, p);
+        uint64_t indices {0};
+        if (hi != lo) for (int i {0}; i < 16; ++i) {
+            int best {0}, bestd {256};
+            for (int j {0}; j < 8; ++j) {
+                int const dj {std::abs(block[i].a - p[j])};
+                if (dj < bestd) bestd = dj, best = j;
+            }
+            indices |= static_cast<uint64_t>(best) << (i * 3);
+        }
+        d[0] = hi;
+        d[1] = lo;
+        for (int i {0}; i < 6; ++i) d[i + 2] = static_cast<uint8_t>(indices >> (i * 8));
+    }
+    template <typename F> void compress(void const * source, void * dest, uint16_t width, uint16_t height, size_t block_size, F encode) {
+        uint8_t const * const s {reinterpret_cast<uint8_t const *>(source)};
+        uint8_t * d {reinterpret_cast<uint8_t *>(dest)};
+        color block[16];
+        for (unsigned y {0}; y < height; y += 4) for (unsigned x {0}; x < width; x += 4, d += block_size) {
+            load_block(s, width, height, x, y, block);
+            encode(block, d);
+        }
+    }
+    void compress_bc1(void const * source, void * dest, uint16_t width, uint16_t height) {
+        compress(source, dest, width, height, 8, [](color const (&block)[16], uint8_t * d) {
+            encode_color(block, true, d);
+        });
+    }
+    void compress_bc3(void const * source, void * dest, uint16_t width, uint16_t height) {
+        compress(source, dest, width, height, 16, [](color const (&block)[16], uint8_t * d) {
+            encode_alpha(block, d);
+            encode_color(block, false, d + 8);
+        });
+    }
+}
@@ -0,0 +1,36 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNx - Part of the NoLifeStory project                               //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+namespace bcn {
+    //Size in bytes of a width by height image made of 4x4 blocks of block_size bytes each
+    //BC1 uses 8 byte blocks while BC2 and BC3 use 16 byte blocks
+    size_t length(uint16_t width, uint16_t height, size_t block_size);
+    //CPU decoders for when the GPU can't take the blocks directly
+    //The output is 32-bit BGRA pixel data, the same as what an uncompressed bitmap gives you
+    void decompress_bc1(void const * source, void * dest, uint16_t width, uint16_t height);
+    void decompress_bc2(void const * source, void * dest, uint16_t width, uint16_t height);
+    void decompress_bc3(void const * source, void * dest, uint16_t width, uint16_t height);
+    //Encoders which take 32-bit BGRA pixel data
+    //BC1 only keeps 1-bit alpha, so pixels with alpha below 128 become fully transparent
+    void compress_bc1(void const * source, void * dest, uint16_t width, uint16_t height);
+    void compress_bc3(void const * source, void * dest, uint16_t width, uint16_t height);
+}
@@ -18,7 +18,17 @@
 
 #include "bitmap.hpp"
 #include "lz4.hpp"
+#include "bcn.hpp"
+#include "file.hpp"
+#include "cache.hpp"
+#include "trace.hpp"
 #include <vector>
+#ifdef NX_ZSTD
+#  include <zstd.h>
+#endif
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#  include <Windows.h>
+#endif
 
 namespace nl {
     bool bitmap::operator<(bitmap const & o) const {
@@ -30,12 +40,64 @@ namespace nl {
     bitmap::operator bool() const {
         return m_data ? true : false;
     }
-    std::vector<uint8_t> buf {};
+    //Each thread decodes into a buffer of its own, so threads never overwrite the pixels another is reading
+    //The buffer is freed when its thread exits
+#if defined(_MSC_VER) && _MSC_VER < 1900
+    //VS2013 has no thread_local, so a fiber local slot holds the buffer and frees it on exit instead
+    void NTAPI free_decode_buffer(void * buffer) {
+        delete static_cast<std::vector<uint8_t> *>(buffer);
+    }
+    DWORD const decode_buffer_slot {FlsAlloc(free_decode_buffer)};
+    std::vector<uint8_t> & decode_buffer() {
+        std::vector<uint8_t> * buffer {static_cast<std::vector<uint8_t> *>(FlsGetValue(decode_buffer_slot))};
+        if (!buffer) {
+            buffer = new std::vector<uint8_t> {};
+            FlsSetValue(decode_buffer_slot, buffer);
+        }
+        return *buffer;
+    }
+#else
+    std::vector<uint8_t> & decode_buffer() {
+        thread_local std::vector<uint8_t> buffer {};
+        return buffer;
+    }
+#endif
     void const * bitmap::data() const {
         if (!m_data) return nullptr;
+        if (trace::active.load(std::memory_order_relaxed)) trace::record(trace::event::bitmap, m_file, m_index);
+        if (zero_copy() || !cache::enabled()) return decode();
+        void const * const cached {cache::find(m_file->m_identity, m_index, length())};
+        if (cached) return cached;
+        void const * const d {decode()};
+        return d ? cache::insert(m_file->m_identity, m_index, d, length()) : nullptr;
+    }
+    void const * bitmap::decode() const {
         size_t const l {length()};
+        std::vector<uint8_t> & buf {decode_buffer()};
         if (l + 0x20 > buf.size()) buf.resize(l + 0x20);
-        lz4::uncompress(reinterpret_cast<uint8_t const *>(m_data) + 4, buf.data(), l);
+        uint8_t const * const d {reinterpret_cast<uint8_t const *>(m_data) + 4};
+        if (m_format == format::bgra8888) switch (m_codec) {
+        case codec::lz4:
+            lz4::uncompress(d, buf.data(), l);
+            return buf.data();
+        case codec::raw:
+            return d;
+        case codec::zstd:
+#ifdef NX_ZSTD
+            if (ZSTD_decompress(buf.data(), l, d, *reinterpret_cast<uint32_t const *>(m_data)) != l) return nullptr;
+            return buf.data();
+#else
+            return nullptr;
+#endif
+        default:
+            return nullptr;
+        }
+        switch (m_format) {
+        case format::bc1: bcn::decompress_bc1(d, buf.data(), m_width, m_height); break;
+        case format::bc2: bcn::decompress_bc2(d, buf.data(), m_width, m_height); break;
+        case format::bc3: bcn::decompress_bc3(d, buf.data(), m_width, m_height); break;
+        default: return nullptr;
+        }
         return buf.data();
     }
     uint16_t bitmap::width() const {
@@ -47,6 +109,44 @@ namespace nl {
     uint32_t bitmap::length() const {
         return 4u * m_width * m_height;
     }
+    bitmap::format bitmap::pixel_format() const {
+        return m_format;
+    }
+    bitmap::codec bitmap::payload_codec() const {
+        return m_codec;
+    }
+    bool bitmap::zero_copy() const {
+        return m_data && m_format == format::bgra8888 && m_codec == codec::raw;
+    }
+    bool bitmap::compressed() const {
+        return m_data && m_format != format::bgra8888;
+    }
+    void const * bitmap::compressed_data() const {
+        return compressed() ? reinterpret_cast<uint8_t const *>(m_data) + 4 : nullptr;
+    }
+    uint32_t bitmap::compressed_length() const {
+        return compressed() ? *reinterpret_cast<uint32_t const *>(m_data) : 0;
+    }
+    void const * bitmap::payload() const {
+        return m_data ? reinterpret_cast<uint8_t const *>(m_data) + 4 : nullptr;
+    }
+    uint32_t bitmap::payload_length() const {
+        return m_data ? *reinterpret_cast<uint32_t const *>(m_data) : 0;
+    }
+    bool bitmap::has_alpha_info() const {
+        return m_data && m_file->m_bitmap_alpha;
+    }
+    bitmap::rect bitmap::bounds() const {
+        if (!has_alpha_info()) return {0, 0, m_width, m_height};
+        file::bitmap_alpha const & a {m_file->m_bitmap_alpha[m_index]};
+        return {a.left, a.top, a.right, a.bottom};
+    }
+    bool bitmap::opaque() const {
+        return has_alpha_info() && m_file->m_bitmap_alpha[m_index].flags & 1;
+    }
+    bool bitmap::partial_alpha() const {
+        return !has_alpha_info() || m_file->m_bitmap_alpha[m_index].flags & 2;
+    }
     size_t bitmap::id() const {
         return reinterpret_cast<size_t>(m_data);
     }
@@ -21,28 +21,86 @@
 #include <cstddef>
 
 namespace nl {
+    class file;
     class bitmap {
     public:
+        //The layout the pixel data is stored in within the file
+        //The values match the top byte of the bitmap table entries
+        enum class format : uint8_t {
+            bgra8888 = 0,
+            bc1 = 1,
+            bc2 = 2,
+            bc3 = 3,
+        };
+        //How the pixel data of a BGRA bitmap is compressed within the file
+        //The values match the second highest byte of the bitmap table entries
+        //BCn blocks are always stored as they are, whatever the codec says
+        enum class codec : uint8_t {
+            lz4 = 0,
+            raw = 1,
+            zstd = 2,
+        };
         //Comparison operators, useful for containers
         bool operator==(bitmap const &) const;
         bool operator<(bitmap const &) const;
         //Returns whether the bitmap is valid or merely null
         explicit operator bool() const;
         //This function decompresses the data on the fly
+        //Block compressed bitmaps are decoded to 32-bit BGRA on the CPU as well
+        //Raw bitmaps are returned straight from the file without any copying
+        //Returns nullptr for zstd bitmaps if NoLifeNx was built without zstd support
         //Do not free the pointer returned by this method
         //Every time this function is called
-        //any previous pointers returned by this method become invalid
+        //any previous pointers returned by this method on the same thread become invalid
+        //unless the bitmap cache is open, in which case they remain valid until it is closed
         void const * data() const;
         uint16_t width() const;
         uint16_t height() const;
         uint32_t length() const;
+        format pixel_format() const;
+        codec payload_codec() const;
+        //Whether data() hands out a pointer straight into the memory mapped file
+        //WzToNx stores these page aligned, so they can be uploaded without any decoding or copying
+        //Unlike other bitmaps the pointer remains valid until the file is destroyed
+        bool zero_copy() const;
+        //Whether the bitmap is stored as BCn blocks that the GPU can take directly
+        bool compressed() const;
+        //The BCn blocks exactly as they are stored, ready for glCompressedTexImage2D
+        //Returns nullptr if the bitmap is not block compressed
+        //The pointer remains valid until the file this bitmap is part of is destroyed
+        void const * compressed_data() const;
+        uint32_t compressed_length() const;
+        //The pixel data exactly as it is stored in the file, whatever the format and codec
+        //Useful for copying bitmaps from one file to another without decoding them
+        void const * payload() const;
+        uint32_t payload_length() const;
+        //Alpha metadata, only available if the converter stored it in the file
+        struct rect {
+            uint16_t left, top, right, bottom;
+        };
+        bool has_alpha_info() const;
+        //The smallest rectangle containing every pixel that isn't fully transparent
+        //right and bottom are exclusive, so a fully transparent bitmap has an empty rectangle
+        //Without alpha metadata this is the whole bitmap
+        rect bounds() const;
+        //Every pixel has full alpha, so the bitmap can be drawn without blending
+        //Without alpha metadata this is false
+        bool opaque() const;
+        //Some pixels have alpha other than 0 or 255, so alpha testing alone won't do
+        //Without alpha metadata this is true
+        bool partial_alpha() const;
         //Returns a unique id, useful for keeping track of what bitmaps you loaded
         size_t id() const;
         //Internal variables
         //They are only public so that the class may be Plain Old Data
         void const * m_data;
         uint16_t m_width, m_height;
+        format m_format;
+        codec m_codec;
+        file const * m_file;
+        uint32_t m_index;
     private:
+        void const * decode() const;
         friend class node;
     };
 }
@@ -0,0 +1,170 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNx - Part of the NoLifeStory project                               //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#include "cache.hpp"
+#ifdef _WIN32
+#  include <Windows.h>
+#else
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+namespace nl {
+    namespace cache {
+        //A file full of zeroes is a valid empty cache, so creating one needs no coordination between processes
+        struct header {
+            std::atomic<uint32_t> magic;
+            uint32_t reserved;
+            std::atomic<uint64_t> used;
+        };
+        //Writers claim a slot by moving it from empty to writing, and readers ignore it until it is ready
+        enum : uint32_t {
+            empty = 0,
+            writing = 1,
+            ready = 2,
+        };
+        struct slot {
+            std::atomic<uint32_t> state;
+            uint32_t index;
+            uint64_t file;
+            uint64_t offset;
+            uint32_t length;
+            uint32_t reserved;
+        };
+        uint32_t const magic {0x4344584E};//NXDC
+        uint32_t const slot_count {0x100000};
+        uint32_t const max_probes {0x40};
+        uint64_t const data_offset {0x40 + slot_count * sizeof(slot)};
+        char * base {nullptr};
+        uint64_t size {0};
+        header * head {nullptr};
+        slot * slots {nullptr};
+        char * data {nullptr};
+        uint64_t data_size {0};
+#ifdef _WIN32
+        void * file_handle {nullptr};
+        void * map_handle {nullptr};
+#else
+        int file_handle {-1};
+#endif
+        uint64_t hash(uint64_t file, uint32_t index) {
+            uint64_t h {file ^ index * 0x9E3779B97F4A7C15ULL};
+            h ^= h >> 31;
+            h *= 0xBF58476D1CE4E5B9ULL;
+            return h ^ h >> 29;
+        }
+        void open(std::string name, uint64_t capacity) {
+            if (base) throw std::runtime_error {"The bitmap cache is already open"};
+            size = data_offset + capacity;
+#ifdef _WIN32
+            file_handle = CreateFileA(name.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_FLAG_RANDOM_ACCESS, nullptr);
+            if (file_handle == INVALID_HANDLE_VALUE) throw std::runtime_error {"Failed to open file " + name};
+            LARGE_INTEGER existing;
+            if (GetFileSizeEx(file_handle, &existing) && static_cast<uint64_t>(existing.QuadPart) > size) size = existing.QuadPart;
+            map_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+            if (!map_handle) throw std::runtime_error {"Failed to create file mapping of file " + name};
+            base = reinterpret_cast<char *>(MapViewOfFile(map_handle, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+            if (!base) throw std::runtime_error {"Failed to map view of file " + name};
+#else
+            file_handle = ::open(name.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+            if (file_handle == -1) throw std::runtime_error {"Failed to open file " + name};
+            struct stat finfo;
+            if (fstat(file_handle, &finfo) == -1) throw std::runtime_error {"Failed to obtain file information of file " + name};
+            //The file is only ever grown, so processes opening it with a smaller capacity just use what's there
+            if (static_cast<uint64_t>(finfo.st_size) >= size) size = finfo.st_size;
+            else if (ftruncate(file_handle, size) == -1) throw std::runtime_error {"Failed to resize file " + name};
+            void * const m {mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_handle, 0)};
+            if (m == MAP_FAILED) throw std::runtime_error {"Failed to create memory mapping of file " + name};
+            base = reinterpret_cast<char *>(m);
+#endif
+            head = reinterpret_cast<header *>(base);
+            uint32_t expected {0};
+            if (!head->magic.compare_exchange_strong(expected, magic) && expected != magic) {
+                close();
+                throw std::runtime_error {name + " is not a bitmap cache"};
+            }
+            slots = reinterpret_cast<slot *>(base + 0x40);
+            data = base + data_offset;
+            data_size = size - data_offset;
+        }
+        void close() {
+            if (!base) return;
+#ifdef _WIN32
+            UnmapViewOfFile(base);
+            CloseHandle(map_handle);
+            CloseHandle(file_handle);
+#else
+            munmap(base, size);
+            ::close(file_handle);
+#endif
+            base = data = nullptr;
+            head = nullptr;
+            slots = nullptr;
+        }
+        bool enabled() {
+            return base != nullptr;
+        }
+        //Another process may have grown the file past what this one mapped, and a corrupt file can point anywhere,
+        //so entries outside the mapping count as misses
+        bool matches(slot const & s, uint64_t file, uint32_t index, uint32_t length) {
+            return s.file == file && s.index == index && s.length == length
+                && s.offset <= data_size && length <= data_size - s.offset;
+        }
+        void const * find(uint64_t file, uint32_t index, uint32_t length) {
+            uint64_t const h {hash(file, index)};
+            for (uint32_t i {0}; i < max_probes; ++i) {
+                slot const & s {slots[(h + i) & (slot_count - 1)]};
+                uint32_t const state {s.state.load(std::memory_order_acquire)};
+                if (state == empty) return nullptr;
+                if (state == ready && matches(s, file, index, length)) return data + s.offset;
+            }
+            return nullptr;
+        }
+        void const * insert(uint64_t file, uint32_t index, void const * decoded, uint32_t length) {
+            //Space is only claimed once it is known to fit, so misses on a full cache leave used alone
+            uint64_t const size {(length + 0xfu) & ~0xfu};
+            uint64_t offset {head->used.load(std::memory_order_relaxed)};
+            do {
+                if (offset + length > data_size) return decoded;
+            } while (!head->used.compare_exchange_weak(offset, offset + size));
+            memcpy(data + offset, decoded, length);
+            uint64_t const h {hash(file, index)};
+            for (uint32_t i {0}; i < max_probes; ++i) {
+                slot & s {slots[(h + i) & (slot_count - 1)]};
+                uint32_t state {empty};
+                if (s.state.compare_exchange_strong(state, writing, std::memory_order_acquire)) {
+                    s.index = index;
+                    s.file = file;
+                    s.offset = offset;
+                    s.length = length;
+                    s.state.store(ready, std::memory_order_release);
+                    break;
+                }
+                //Another process got there first, so our copy just goes unused
+                if (state == ready && matches(s, file, index, length)) return data + s.offset;
+            }
+            return data + offset;
+        }
+    }
+}
@@ -0,0 +1,45 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNx - Part of the NoLifeStory project                               //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace nl {
+    //An opt-in cache of decoded bitmaps kept in a memory mapped file
+    //Every process that opens the same cache file shares the decoded data through the page cache,
+    //so each bitmap only has to be decompressed once across all of them
+    //Entries are keyed by the identity of the nx file and the index of the bitmap within it,
+    //so a changed nx file simply stops hitting its old entries
+    //The file never shrinks, delete it while nothing is using it to reclaim the space
+    namespace cache {
+        //Opens the cache file, creating it if it doesn't exist yet
+        //Afterwards bitmap::data() looks in the cache first and adds anything it decodes
+        //capacity is how many bytes of decoded data the file can hold at most
+        //Only call this once, before accessing any bitmaps
+        void open(std::string name, uint64_t capacity = 0x40000000);
+        void close();
+        bool enabled();
+        //Returns nullptr if the bitmap isn't in the cache
+        //The pointer remains valid until the cache is closed
+        void const * find(uint64_t file, uint32_t index, uint32_t length);
+        //Copies the decoded data into the cache and returns where it ended up
+        //If the cache is full the data is returned as it is
+        void const * insert(uint64_t file, uint32_t index, void const * data, uint32_t length);
+    }
+}
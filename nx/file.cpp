@@ -27,7 +27,10 @@
 #  include <sys/mman.h>
 #  include <unistd.h>
 #endif
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
+#include <vector>
 
 namespace nl {
     file::file(std::string name) {
@@ -38,6 +41,10 @@ namespace nl {
         if (!m_map) throw std::runtime_error {"Failed to create file mapping of file " + name};
         m_base = MapViewOfFile(m_map, FILE_MAP_READ, 0, 0, 0);
         if (!m_base) throw std::runtime_error {"Failed to map view of file " + name};
+        LARGE_INTEGER size;
+        FILETIME modified;
+        if (!GetFileSizeEx(m_file, &size) || !GetFileTime(m_file, nullptr, nullptr, &modified)) throw std::runtime_error {"Failed to obtain file information of file " + name};
+        uint64_t const identity[2] {static_cast<uint64_t>(size.QuadPart), static_cast<uint64_t>(modified.dwHighDateTime) << 32 | modified.dwLowDateTime};
 #else
         m_file = open(name.c_str(), O_RDONLY);
         if (m_file == -1) throw std::runtime_error {"Failed to open file " + name};
@@ -46,15 +53,57 @@ namespace nl {
         m_size = finfo.st_size;
         m_base = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_file, 0);
         if (reinterpret_cast<intptr_t>(m_base) == -1) throw std::runtime_error {"Failed to create memory mapping of file " + name};
+        //Whole seconds aren't enough to tell apart a file rewritten right after it was cached
+#ifdef __APPLE__
+        uint64_t const nanoseconds {static_cast<uint64_t>(finfo.st_mtimespec.tv_nsec)};
+#else
+        uint64_t const nanoseconds {static_cast<uint64_t>(finfo.st_mtim.tv_nsec)};
+#endif
+        uint64_t const identity[3] {static_cast<uint64_t>(finfo.st_size), static_cast<uint64_t>(finfo.st_mtime), nanoseconds};
 #endif
         m_header = reinterpret_cast<header const *>(m_base);
         if (m_header->magic != 0x34474B50) throw std::runtime_error {name + " is not a PKG4 NX file"};
+        m_identity = 14695981039346656037ULL;
+        for (uint8_t const * p {reinterpret_cast<uint8_t const *>(identity)}, * end {p + sizeof(identity)}; p != end; ++p) {
+            m_identity ^= *p;
+            m_identity *= 1099511628211ULL;
+        }
+        for (uint8_t const * p {reinterpret_cast<uint8_t const *>(m_header)}, * end {p + sizeof(header)}; p != end; ++p) {
+            m_identity ^= *p;
+            m_identity *= 1099511628211ULL;
+        }
         m_node_table = reinterpret_cast<node::data const *>(reinterpret_cast<char const *>(m_base) + m_header->node_offset);
         m_string_table = reinterpret_cast<uint64_t const *>(reinterpret_cast<char const *>(m_base) + m_header->string_offset);
         m_bitmap_table = reinterpret_cast<uint64_t const *>(reinterpret_cast<char const *>(m_base) + m_header->bitmap_offset);
         m_audio_table = reinterpret_cast<uint64_t const *>(reinterpret_cast<char const *>(m_base) + m_header->audio_offset);
+        //Files without the extension header have one of their tables right after the header instead
+        uint64_t first {m_header->node_offset < m_header->string_offset ? m_header->node_offset : m_header->string_offset};
+        if (m_header->bitmap_count && m_header->bitmap_offset < first) first = m_header->bitmap_offset;
+        if (m_header->audio_count && m_header->audio_offset < first) first = m_header->audio_offset;
+        extension_header const * const ext {reinterpret_cast<extension_header const *>(m_header + 1)};
+        if (first >= sizeof(header) + sizeof(extension_header) && ext->magic == 0x3158584E) {
+            m_sections = reinterpret_cast<section const *>(reinterpret_cast<char const *>(m_base) + ext->section_offset);
+            m_section_count = ext->section_count;
+        } else {
+            m_sections = nullptr;
+            m_section_count = 0;
+        }
+        uint32_t count {0};
+        m_bitmap_alpha = reinterpret_cast<bitmap_alpha const *>(find_section(section_tag::bitmap_alpha, count));
+        if (count != m_header->bitmap_count) m_bitmap_alpha = nullptr;
+        m_audio_info = reinterpret_cast<audio_info const *>(find_section(section_tag::audio_info, count));
+        if (count != m_header->audio_count) m_audio_info = nullptr;
+        m_arrays = reinterpret_cast<array_entry const *>(find_section(section_tag::arrays, m_array_count));
+        m_string_blocks = reinterpret_cast<uint32_t const *>(find_section(section_tag::front_coded_strings, count));
+        if (count != m_header->string_count) m_string_blocks = nullptr;
+        if (m_string_blocks) {
+            uint32_t const blocks {(count + 15) / 16};
+            m_decoded_strings.reset(new std::atomic<char const *>[blocks]);
+            for (uint32_t i {0}; i < blocks; ++i) m_decoded_strings[i] = nullptr;
+        }
     }
     file::~file() {
+        if (m_string_blocks) for (uint32_t i {0}, blocks {(m_header->string_count + 15) / 16}; i < blocks; ++i) delete[] m_decoded_strings[i].load();
 #ifdef _WIN32
         UnmapViewOfFile(m_base);
         CloseHandle(m_map);
@@ -82,8 +131,70 @@ namespace nl {
     uint32_t file::node_count() const {
         return m_header->node_count;
     }
+    bool file::front_coded_strings() const {
+        return m_string_blocks != nullptr;
+    }
+    void file::evict() const {
+#ifdef _WIN32
+        LARGE_INTEGER size;
+        //Unlocking pages that aren't locked removes them from the working set
+        if (GetFileSizeEx(m_file, &size)) VirtualUnlock(const_cast<void *>(m_base), static_cast<SIZE_T>(size.QuadPart));
+#else
+        //The page cache only lets go of pages nothing has mapped
+        madvise(const_cast<void *>(m_base), m_size, MADV_DONTNEED);
+#  ifdef POSIX_FADV_DONTNEED
+        posix_fadvise(m_file, 0, 0, POSIX_FADV_DONTNEED);
+#  endif
+#endif
+    }
+    void const * file::find_section(section_tag tag, uint32_t & count) const {
+        for (uint32_t i {0}; i < m_section_count; ++i) if (m_sections[i].tag == static_cast<uint32_t>(tag)) {
+            count = m_sections[i].count;
+            return reinterpret_cast<char const *>(m_base) + m_sections[i].offset;
+        }
+        count = 0;
+        return nullptr;
+    }
     std::string file::get_string(uint32_t i) const {
-        char const * const s {reinterpret_cast<char const *>(m_base) + m_string_table[i]};
+        std::pair<char const *, size_t> const s {string_fast(i)};
+        return {s.first, s.second};
+    }
+    std::pair<char const *, size_t> file::string_fast(uint32_t i) const {
+        char const * s;
+        if (!m_string_blocks) s = reinterpret_cast<char const *>(m_base) + m_string_table[i];
+        else {
+            char const * d {m_decoded_strings[i >> 4].load(std::memory_order_acquire)};
+            if (!d) d = decode_strings(i >> 4);
+            s = d + reinterpret_cast<uint32_t const *>(d)[i & 15];
+        }
         return {s + 2, *reinterpret_cast<uint16_t const *>(s)};
     }
+    //A decoded block starts with the offset of each of its strings, followed by the strings with their lengths
+    char const * file::decode_strings(uint32_t block) const {
+        uint32_t const count {std::min<uint32_t>(16, m_header->string_count - block * 16)};
+        uint8_t const * p {reinterpret_cast<uint8_t const *>(m_string_blocks) + m_string_blocks[block]};
+        std::vector<char> d(16 * 4);
+        std::string last {};
+        for (uint32_t i {0}; i < count; ++i) {
+            size_t const shared {p[0]};
+            size_t rest {p[1]};
+            p += 2;
+            if (rest == 0xff) rest = *reinterpret_cast<uint16_t const *>(p), p += 2;
+            last.resize(shared);
+            last.append(reinterpret_cast<char const *>(p), rest);
+            p += rest;
+            uint32_t const offset {static_cast<uint32_t>(d.size())};
+            uint16_t const length {static_cast<uint16_t>(last.size())};
+            std::memcpy(d.data() + i * 4, &offset, 4);
+            d.insert(d.end(), reinterpret_cast<char const *>(&length), reinterpret_cast<char const *>(&length) + 2);
+            d.insert(d.end(), last.begin(), last.end());
+        }
+        char * const decoded {new char[d.size()]};
+        std::memcpy(decoded, d.data(), d.size());
+        //Another thread may have decoded the same block in the meantime, in which case theirs wins
+        char const * expected {nullptr};
+        if (m_decoded_strings[block].compare_exchange_strong(expected, decoded, std::memory_order_acq_rel)) return decoded;
+        delete[] decoded;
+        return expected;
+    }
 }
@@ -17,7 +17,9 @@
 //////////////////////////////////////////////////////////////////////////////
 
 #pragma once
+#include <atomic>
 #include <cstdint>
+#include <memory>
 #include <string>
 
 namespace nl {
@@ -42,7 +44,13 @@ namespace nl {
         uint32_t audio_count() const;
         //Returns the number of nodes in the file
         uint32_t node_count() const;
+        //Whether the strings are stored front coded, so tools rewriting the file can keep them that way
+        bool front_coded_strings() const;
         std::string get_string(uint32_t) const;
+        //Drops the pages of the file from this process and asks the OS to drop them from its cache as well,
+        //so that the next access reads from disk like the first one after a reboot
+        //Windows only lets us trim them from the working set, so there they come back from the system cache
+        void evict() const;
     private:
 #pragma pack(push, 1)
         struct header {
@@ -56,15 +64,74 @@ namespace nl {
             uint32_t const audio_count;
             uint64_t const audio_offset;
         };
+        //Optionally follows the header to list extra sections that older readers ignore
+        struct extension_header {
+            uint32_t const magic;
+            uint32_t const section_count;
+            uint64_t const section_offset;
+        };
+        struct section {
+            uint32_t const tag;
+            uint32_t const count;
+            uint64_t const offset;
+        };
+        //Alpha metadata for each bitmap, computed during conversion
+        struct bitmap_alpha {
+            uint16_t const left, top, right, bottom;
+            uint32_t const flags;
+        };
+        //Format metadata for each audio, parsed from the Sound_DX8 header during conversion
+        struct audio_info {
+            uint32_t const sample_rate;
+            uint32_t const duration;
+            uint16_t const channels;
+            uint16_t const bits_per_sample;
+            uint8_t const codec;
+            uint8_t const reserved;
+            uint16_t const header_length;
+        };
+        //Where the elements of each packed array are and what they are
+        struct array_entry {
+            uint64_t const offset;
+            uint32_t const count;
+            uint8_t const kind;
+            uint8_t const reserved[3];
+        };
 #pragma pack(pop)
+        enum class section_tag : uint32_t {
+            bitmap_alpha = 0x41544D42,//BMTA
+            audio_info = 0x4D445541,//AUDM
+            front_coded_strings = 0x32525453,//STR2
+            arrays = 0x59525241,//ARRY
+        };
+        //Returns nullptr if the file doesn't have the section
+        void const * find_section(section_tag, uint32_t & count) const;
+        //Returns the string with that id, which remains valid for as long as the file is open
+        std::pair<char const *, size_t> string_fast(uint32_t) const;
+        //Decodes a block of front coded strings the first time one of them is needed
+        char const * decode_strings(uint32_t block) const;
         file(const file &);//Todo: Replace with = delete once VS has support for it.
         file & operator=(const file &);//Todo: Replace with = delete once VS has support for it.
         void const * m_base;
         struct node_data const * m_node_table;
         uint64_t const * m_string_table;
+        //Files with the front coded string section have a table of block offsets instead,
+        //and each block is decoded into the same layout as the plain string table on first use
+        uint32_t const * m_string_blocks;
+        std::unique_ptr<std::atomic<char const *>[]> m_decoded_strings;
+        //The low 48 bits of a bitmap table entry are the offset of the bitmap,
+        //the byte above that is the bitmap::codec and the top byte is the bitmap::format
         uint64_t const * m_bitmap_table;
         uint64_t const * m_audio_table;
+        bitmap_alpha const * m_bitmap_alpha;
+        audio_info const * m_audio_info;
+        array_entry const * m_arrays;
+        uint32_t m_array_count;
         header const * m_header;
+        //Distinguishes this file from any other nx file, or an older version of it, in the bitmap cache
+        uint64_t m_identity;
+        section const * m_sections;
+        uint32_t m_section_count;
 #ifdef _WIN32
         void * m_file;
         void * m_map;
@@ -39,6 +39,7 @@ You can contact the author at :
 #include <cassert>
 #include <cstring>
 #include <cstddef>
+#include <vector>
 
 namespace lz4 {
     size_t const copylength {8u};
@@ -117,4 +118,130 @@ namespace lz4 {
             }
         }
     }
+    size_t const minmatch {4u};
+    size_t const mflimit {12u};
+    size_t const lastliterals {5u};
+    size_t const maxdistance {0xffffu};
+    size_t const hashbits {12u};
+    size_t compress_bound(size_t isize) {
+        return isize + isize / 255u + 16u;
+    }
+    uint32_t read32(uint8_t const * p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    size_t hash32(uint32_t v) {
+        return (v * 2654435761u) >> (32u - hashbits);
+    }
+    uint8_t * write_length(uint8_t * op, size_t length) {
+        for (; length >= 255u; length -= 255u) *op++ = 255u;
+        *op++ = static_cast<uint8_t>(length);
+        return op;
+    }
+    uint8_t * write_sequence(uint8_t * op, uint8_t const * anchor, size_t literals, size_t offset, size_t matchlength) {
+        uint8_t * const token {op++};
+        *token = static_cast<uint8_t>((literals < runmask ? literals : runmask) << mlbits);
+        if (literals >= runmask) op = write_length(op, literals - runmask);
+        std::memcpy(op, anchor, literals);
+        op += literals;
+        if (!offset) return op;
+        *op++ = static_cast<uint8_t>(offset);
+        *op++ = static_cast<uint8_t>(offset >> 8);
+        matchlength -= minmatch;
+        *token |= static_cast<uint8_t>(matchlength < mlmask ? matchlength : mlmask);
+        if (matchlength >= mlmask) op = write_length(op, matchlength - mlmask);
+        return op;
+    }
+    size_t compress(void const * source, void * dest, size_t isize) {
+        uint8_t const * const base {reinterpret_cast<uint8_t const *>(source)};
+        uint8_t const * const iend {base + isize};
+        uint8_t const * ip {base};
+        uint8_t const * anchor {base};
+        uint8_t * const obase {reinterpret_cast<uint8_t *>(dest)};
+        uint8_t * op {obase};
+        if (isize > mflimit) {
+            uint8_t const * const ilimit {iend - mflimit};
+            uint8_t const * const matchlimit {iend - lastliterals};
+            uint32_t table[1u << hashbits] {};
+            ++ip;
+            while (ip < ilimit) {
+                uint32_t const seq {read32(ip)};
+                uint32_t & entry {table[hash32(seq)]};
+                uint8_t const * ref {base + entry};
+                entry = static_cast<uint32_t>(ip - base);
+                if (ref >= ip || static_cast<size_t>(ip - ref) > maxdistance || read32(ref) != seq) {
+                    ++ip;
+                    continue;
+                }
+                while (ip > anchor && ref > base && ip[-1] == ref[-1]) --ip, --ref;
+                size_t length {minmatch};
+                while (ip + length < matchlimit && ip[length] == ref[length]) ++length;
+                op = write_sequence(op, anchor, static_cast<size_t>(ip - anchor), static_cast<size_t>(ip - ref), length);
+                ip += length;
+                anchor = ip;
+                if (ip - 2 > base) table[hash32(read32(ip - 2))] = static_cast<uint32_t>(ip - 2 - base);
+            }
+        }
+        op = write_sequence(op, anchor, static_cast<size_t>(iend - anchor), 0, 0);
+        return static_cast<size_t>(op - obase);
+    }
+    size_t const hcbits {15u};
+    size_t const hcattempts {256u};
+    size_t compress_hc(void const * source, void * dest, size_t isize) {
+        uint8_t const * const base {reinterpret_cast<uint8_t const *>(source)};
+        uint8_t const * const iend {base + isize};
+        uint8_t const * ip {base};
+        uint8_t const * anchor {base};
+        uint8_t * const obase {reinterpret_cast<uint8_t *>(dest)};
+        uint8_t * op {obase};
+        if (isize > mflimit) {
+            uint8_t const * const ilimit {iend - mflimit};
+            uint8_t const * const matchlimit {iend - lastliterals};
+            //Every position links back to the previous one with the same hash, as long as it's within reach
+            std::vector<uint32_t> head(1u << hcbits, 0xffffffffu);
+            std::vector<uint16_t> chain(maxdistance + 1u, 0);
+            size_t next {0};
+            auto insert = [&](size_t upto) {
+                for (; next < upto; ++next) {
+                    uint32_t & h {head[(read32(base + next) * 2654435761u) >> (32u - hcbits)]};
+                    size_t const delta {h == 0xffffffffu ? 0 : next - h};
+                    chain[next & maxdistance] = static_cast<uint16_t>(delta > maxdistance ? 0 : delta);
+                    h = static_cast<uint32_t>(next);
+                }
+            };
+            while (ip < ilimit) {
+                size_t const pos {static_cast<size_t>(ip - base)};
+                insert(pos);
+                uint32_t const seq {read32(ip)};
+                uint32_t const first {head[(seq * 2654435761u) >> (32u - hcbits)]};
+                size_t best {0};
+                uint8_t const * ref {nullptr};
+                if (first != 0xffffffffu && pos - first <= maxdistance) {
+                    size_t cand {first};
+                    for (size_t attempts {hcattempts}; attempts; --attempts) {
+                        uint8_t const * const c {base + cand};
+                        if (c[best] == ip[best] && read32(c) == seq) {
+                            size_t length {minmatch};
+                            while (ip + length < matchlimit && ip[length] == c[length]) ++length;
+                            if (length > best) best = length, ref = c;
+                            if (ip + length >= matchlimit) break;
+                        }
+                        size_t const delta {chain[cand & maxdistance]};
+                        if (!delta || delta > cand || pos - (cand - delta) > maxdistance) break;
+                        cand -= delta;
+                    }
+                }
+                if (best < minmatch) {
+                    ++ip;
+                    continue;
+                }
+                op = write_sequence(op, anchor, static_cast<size_t>(ip - anchor), static_cast<size_t>(ip - ref), best);
+                ip += best;
+                anchor = ip;
+            }
+        }
+        op = write_sequence(op, anchor, static_cast<size_t>(iend - anchor), 0, 0);
+        return static_cast<size_t>(op - obase);
+    }
 }
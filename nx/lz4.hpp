@@ -39,4 +39,12 @@ You can contact the author at :
 
 namespace lz4 {
     void uncompress(void const * source, void * dest, size_t osize);
+    //Worst case size of the compressed form of isize bytes of input
+    size_t compress_bound(size_t isize);
+    //Compresses isize bytes from source into dest and returns the compressed size
+    //dest must have room for at least compress_bound(isize) bytes
+    size_t compress(void const * source, void * dest, size_t isize);
+    //Slower, but searches much harder for matches to produce smaller output
+    //The output decompresses just as fast as that of compress
+    size_t compress_hc(void const * source, void * dest, size_t isize);
 }
@@ -20,6 +20,8 @@
 #include "file.hpp"
 #include "bitmap.hpp"
 #include "audio.hpp"
+#include "array.hpp"
+#include "trace.hpp"
 #include <cstring>
 #include <stdexcept>
 
@@ -27,6 +29,9 @@ namespace nl {
     node::node(node const & o) : m_data {o.m_data}, m_file {o.m_file} {}
     node::node(data const * const & d, file const * const & f) : m_data {d}, m_file {f} {}
     node node::begin() const {
+        if (trace::active.load(std::memory_order_relaxed) && m_data) {
+            trace::record(trace::event::visit, m_file, static_cast<uint32_t>(m_data - m_file->m_node_table));
+        }
         return {m_data ? m_file->m_node_table + m_data->children : nullptr, m_file};
     }
     node node::end() const {
@@ -192,10 +197,17 @@ namespace nl {
         return m_data && m_data->type == type::vector ? to_vector() : std::pair<int32_t, int32_t> {0, 0};
     }
     bitmap node::get_bitmap() const {
-        return m_data && m_data->type == type::bitmap && m_file->m_header->bitmap_count ? to_bitmap() : bitmap {nullptr, 0, 0};
+        return m_data && m_data->type == type::bitmap && m_file->m_header->bitmap_count ? to_bitmap() : bitmap {nullptr, 0, 0, bitmap::format::bgra8888, bitmap::codec::lz4, nullptr, 0};
     }
     audio node::get_audio() const {
-        return m_data && m_data->type == type::audio && m_file->m_header->audio_count ? to_audio() : audio {nullptr, 0};
+        return m_data && m_data->type == type::audio && m_file->m_header->audio_count ? to_audio() : audio {nullptr, 0, nullptr, 0};
+    }
+    array node::get_array() const {
+        if (!m_data || m_data->type != type::none || !m_data->array.count || m_data->array.index >= m_file->m_array_count) {
+            return {nullptr, 0, array::kind::integer};
+        }
+        file::array_entry const & e {m_file->m_arrays[m_data->array.index]};
+        return {reinterpret_cast<char const *>(m_file->m_base) + e.offset, e.count, static_cast<array::kind>(e.kind)};
     }
     bool node::get_bool() const {
         return m_data && m_data->type == type::integer && to_integer() ? true : false;
@@ -214,8 +226,7 @@ namespace nl {
     }
     std::pair<char const *, size_t> node::name_fast() const {
         if (!m_data) return {nullptr, 0};
-        char const * s {reinterpret_cast<char const *>(m_file->m_base) + m_file->m_string_table[m_data->name]};
-        return {s + 2, *reinterpret_cast<uint16_t const *>(s)};
+        return m_file->string_fast(m_data->name);
     }
     size_t node::size() const {
         return m_data ? m_data->num : 0U;
@@ -228,12 +239,13 @@ namespace nl {
         data const * p {m_file->m_node_table + m_data->children};
         size_t n {m_data->num};
         char const * const b {reinterpret_cast<const char *>(m_file->m_base)};
-        uint64_t const * const t {m_file->m_string_table};
+        //Front coded strings go through the file, which keeps them with their length in front as well
+        uint64_t const * const t {m_file->m_string_blocks ? nullptr : m_file->m_string_table};
         for (;;) {
             if (!n) return {nullptr, m_file};
             size_t const n2 {n >> 1};
             data const * const p2 {p + n2};
-            char const * const sl {b + t[p2->name]};
+            char const * const sl {t ? b + t[p2->name] : m_file->string_fast(p2->name).first - 2};
             size_t const l1 {*reinterpret_cast<uint16_t const *>(sl)};
             uint8_t const * s {reinterpret_cast<uint8_t const *>(sl + 2)};
             uint8_t const * os {reinterpret_cast<uint8_t const *>(o)};
@@ -253,7 +265,12 @@ namespace nl {
             if (z) continue;
             else if (l1 < l) p = p2 + 1, n -= n2 + 1;
             else if (l1 > l) n = n2;
-            else return {p2, m_file};
+            else {
+                if (trace::active.load(std::memory_order_relaxed)) {
+                    trace::record(trace::event::lookup, m_file, static_cast<uint32_t>(p2 - m_file->m_node_table));
+                }
+                return {p2, m_file};
+            }
         }
     }
     int64_t node::to_integer() const {
@@ -269,9 +286,11 @@ namespace nl {
         return {m_data->vector[0], m_data->vector[1]};
     }
     bitmap node::to_bitmap() const {
-        return {reinterpret_cast<char const *>(m_file->m_base) + m_file->m_bitmap_table[m_data->bitmap.index], m_data->bitmap.width, m_data->bitmap.height};
+        uint64_t const entry {m_file->m_bitmap_table[m_data->bitmap.index]};
+        return {reinterpret_cast<char const *>(m_file->m_base) + (entry & 0xffffffffffff), m_data->bitmap.width, m_data->bitmap.height, static_cast<bitmap::format>(entry >> 56), static_cast<bitmap::codec>(entry >> 48 & 0xff), m_file, m_data->bitmap.index};
     }
     audio node::to_audio() const {
-        return {reinterpret_cast<char const *>(m_file->m_base) + m_file->m_audio_table[m_data->audio.index], m_data->audio.length};
+        return {reinterpret_cast<char const *>(m_file->m_base) + m_file->m_audio_table[m_data->audio.index], m_data->audio.length,
+            m_file, m_data->audio.index};
     }
 }
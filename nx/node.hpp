@@ -23,6 +23,7 @@
 namespace nl {
     class bitmap;
     class audio;
+    class array;
     class file;
     class node {
     public:
@@ -107,6 +108,8 @@ namespace nl {
         std::pair<int32_t, int32_t> get_vector() const;
         class bitmap get_bitmap() const;
         class audio get_audio() const;
+        //Returns a null array unless the converter packed the children of this node into one
+        class array get_array() const;
         bool get_bool() const;
         bool get_bool(bool) const;
         //Returns the x and y coordinates of the vector data value
@@ -157,6 +160,11 @@ namespace nl {
                 uint32_t index;
                 uint32_t length;
             } const audio;
+            //Only for nodes without data, which older readers ignore, and only when count isn't 0
+            struct {
+                uint32_t index;
+                uint32_t count;
+            } const array;
         };
     };
 #pragma pack(pop)
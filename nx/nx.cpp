@@ -18,6 +18,7 @@
 #include "nx.hpp"
 #include "file.hpp"
 #include "node.hpp"
+#include "overlay.hpp"
 #include <fstream>
 #include <vector>
 #include <memory>
@@ -25,6 +26,9 @@
 namespace nl {
     namespace nx {
         std::vector<std::unique_ptr<file>> files {};
+        //One stack for Data.nx, or one for each of the standard files
+        std::vector<std::unique_ptr<overlay>> overlays {};
+        bool split {false};
         bool exists(std::string name) {
             return std::ifstream {name}.is_open();
         }
@@ -36,6 +40,7 @@ namespace nl {
         node base, character, effect, etc, item, map, mob, morph, npc, quest, reactor, skill, sound, string, tamingmob, ui;
         void load_all() {
             if (exists("Base.nx")) {
+                split = true;
                 base = add_file("Base.nx");
                 character = add_file("Character.nx");
                 effect = add_file("Effect.nx");
@@ -73,5 +78,34 @@ namespace nl {
                 throw std::runtime_error {"Failed to locate nx files."};
             }
         }
+        void load_all(std::vector<std::string> const & names) {
+            load_all();
+            std::vector<node> roots {};
+            for (std::string const & name : names) {
+                if (!exists(name)) throw std::runtime_error {"Failed to locate " + name};
+                roots.push_back(add_file(name));
+            }
+            if (roots.empty()) return;
+            if (!split) {
+                roots.push_back(base);
+                overlays.emplace_back(new overlay {roots});
+                return;
+            }
+            std::pair<char const *, node> const standard[] {{"Character", character}, {"Effect", effect}, {"Etc", etc},
+                {"Item", item}, {"Map", map}, {"Mob", mob}, {"Morph", morph}, {"Npc", npc}, {"Quest", quest},
+                {"Reactor", reactor}, {"Skill", skill}, {"Sound", sound}, {"String", string},
+                {"TamingMob", tamingmob}, {"UI", ui}};
+            for (std::pair<char const *, node> const & s : standard) {
+                std::vector<node> stack {};
+                for (node const & r : roots) if (r[s.first]) stack.push_back(r[s.first]);
+                if (stack.empty() || !s.second) continue;
+                stack.push_back(s.second);
+                overlays.emplace_back(new overlay {stack});
+            }
+        }
+        view overlaid(node n) {
+            for (std::unique_ptr<overlay> const & o : overlays) if (o->contains(n)) return o->find(n);
+            return {n, nullptr};
+        }
     }
 }
@@ -17,9 +17,12 @@
 //////////////////////////////////////////////////////////////////////////////
 
 #pragma once
+#include <string>
+#include <vector>
 
 namespace nl {
     class node;
+    class view;
     namespace nx {
         //Pre-defined nodes to access standard MapleStory style data
         //Make sure you called load_all first
@@ -27,5 +30,12 @@ namespace nl {
         //Loads the pre-defined nodes from a standard setup of nx files for MapleStory
         //Only call this function once
         void load_all();
+        //Same as above, but the nx files named in overlays are stacked on top of the standard ones,
+        //the first one taking precedence, so that small patch files can shadow the large ones
+        //Overlays are laid out like Data.nx and only need to contain what changed
+        //The pre-defined nodes still refer to the standard files, look them up through overlaid to see the changes
+        void load_all(std::vector<std::string> const & overlays);
+        //The node at the same path as the given node seen through the overlays
+        view overlaid(node);
     }
 }
@@ -0,0 +1,143 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNx - Part of the NoLifeStory project                               //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#include "overlay.hpp"
+#include "file.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace nl {
+    namespace {
+        //The order children are sorted in within a file
+        bool name_less(node const & a, node const & b) {
+            std::pair<char const *, size_t> const x {a.name_fast()}, y {b.name_fast()};
+            int const c {std::memcmp(x.first, y.first, std::min(x.second, y.second))};
+            return c ? c < 0 : x.second < y.second;
+        }
+    }
+    view::iterator::iterator(node n, overlay const * o) : m_node {n}, m_merged {nullptr}, m_index {0}, m_overlay {o} {}
+    view::iterator::iterator(std::vector<node> const * v, size_t i, overlay const * o) :
+        m_node {i < v->size() ? (*v)[i] : node {}}, m_merged {v}, m_index {i}, m_overlay {o} {}
+    view view::iterator::operator*() const {
+        return {m_node, m_overlay};
+    }
+    view::iterator & view::iterator::operator++() {
+        if (!m_merged) return ++m_node, *this;
+        ++m_index;
+        m_node = m_index < m_merged->size() ? (*m_merged)[m_index] : node {};
+        return *this;
+    }
+    bool view::iterator::operator==(iterator const & o) const {
+        return m_node == o.m_node;
+    }
+    bool view::iterator::operator!=(iterator const & o) const {
+        return m_node != o.m_node;
+    }
+    view::view(node n, overlay const * o) : m_node {n}, m_overlay {o} {}
+    view::iterator view::begin() const {
+        if (!overlaid()) return {m_node.begin(), m_overlay};
+        return {&merged(), 0, m_overlay};
+    }
+    view::iterator view::end() const {
+        if (!overlaid()) return {m_node.end(), m_overlay};
+        return {node {}, m_overlay};
+    }
+    view::operator bool() const {
+        return static_cast<bool>(m_node);
+    }
+    view view::operator[](std::string const & o) const {
+        return get_child(o.c_str(), o.length());
+    }
+    view view::operator[](char const * o) const {
+        return get_child(o, std::strlen(o));
+    }
+    view view::operator[](std::pair<char const *, size_t> const & o) const {
+        return get_child(o.first, o.second);
+    }
+    node const & view::operator*() const {
+        return m_node;
+    }
+    node const * view::operator->() const {
+        return &m_node;
+    }
+    view::operator node() const {
+        return m_node;
+    }
+    bool view::overlaid() const {
+        return m_overlay && m_overlay->below(m_node);
+    }
+    size_t view::size() const {
+        return overlaid() ? merged().size() : m_node.size();
+    }
+    view view::get_child(char const * o, size_t l) const {
+        //Nodes nothing shadows have no node below them, so this is a single lookup for them
+        for (node n {m_node}; n; n = m_overlay ? m_overlay->below(n) : node {}) {
+            node const c {n[std::make_pair(o, l)]};
+            if (c) return {c, m_overlay};
+        }
+        return {node {}, m_overlay};
+    }
+    std::vector<node> const & view::merged() const {
+        return m_overlay->m_merged.find(m_node.m_data)->second;
+    }
+    overlay::overlay(std::vector<node> roots) : m_layers {}, m_root {roots.empty() ? node {} : roots.front()},
+        m_base {roots.empty() ? nullptr : roots.back().m_file}, m_above {}, m_merged {} {
+        if (roots.size() < 2) return;
+        m_layers.resize(roots.size() - 1);
+        //Each file is linked against the ones below it, so those have to be done first
+        for (size_t i {roots.size() - 1}; i--;) {
+            layer & l {m_layers[i]};
+            l.source = roots[i].m_file;
+            l.root = l.source->root().m_data;
+            l.below.resize(l.source->node_count());
+            link(l, roots[i], {roots[i + 1], this});
+        }
+        //Every node that shadows another is in m_above, and merging needs every file linked
+        for (auto const & a : m_above) merge(a.second);
+    }
+    view overlay::root() const {
+        return {m_root, this};
+    }
+    view overlay::find(node n) const {
+        for (auto it = m_above.find(n.m_data); it != m_above.end(); it = m_above.find(n.m_data)) n = it->second;
+        return {n, this};
+    }
+    node overlay::below(node n) const {
+        if (!n) return {};
+        for (layer const & l : m_layers) if (l.source == n.m_file) return l.below[static_cast<size_t>(n.m_data - l.root)];
+        return {};
+    }
+    bool overlay::contains(node n) const {
+        return n.m_file == m_base || m_above.count(n.m_data) || below(n);
+    }
+    void overlay::link(layer & l, node n, view b) {
+        if (!b) return;
+        l.below[static_cast<size_t>(n.m_data - l.root)] = *b;
+        m_above[b->m_data] = n;
+        for (node c : n) link(l, c, b[c.name_fast()]);
+    }
+    void overlay::merge(node n) {
+        std::vector<node> & v {m_merged[n.m_data]};
+        for (node m {n}; m; m = below(m)) for (node c : m) v.push_back(c);
+        //The sort is stable, so of the children sharing a name the one from the topmost file comes first
+        std::stable_sort(v.begin(), v.end(), name_less);
+        v.erase(std::unique(v.begin(), v.end(), [](node const & a, node const & b) {
+            return !name_less(a, b) && !name_less(b, a);
+        }), v.end());
+    }
+}
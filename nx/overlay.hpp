@@ -0,0 +1,108 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNx - Part of the NoLifeStory project                               //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "node.hpp"
+#include <unordered_map>
+#include <vector>
+
+namespace nl {
+    class overlay;
+    //A node as seen through a stack of nx files, where each file shadows the ones below it
+    //Children are looked up in the topmost file that has the node, falling through to the files below
+    //and the data is always that of the topmost file
+    //Nodes no overlay touches have nothing below them, so they cost about the same as a plain node
+    class view {
+    public:
+        class iterator {
+        public:
+            view operator*() const;
+            iterator & operator++();
+            bool operator==(iterator const &) const;
+            bool operator!=(iterator const &) const;
+        private:
+            iterator(node, overlay const *);
+            iterator(std::vector<node> const *, size_t, overlay const *);
+            node m_node;
+            std::vector<node> const * m_merged;
+            size_t m_index;
+            overlay const * m_overlay;
+            friend class view;
+        };
+        view() = default;
+        //The node has to be the topmost one at its path, use overlay::find() for any other node
+        view(node, overlay const *);
+        //Children are enumerated in the same sorted order as within a single file,
+        //with the children of every file merged together
+        iterator begin() const;
+        iterator end() const;
+        explicit operator bool() const;
+        view operator[](std::string const &) const;
+        view operator[](char const *) const;
+        view operator[](std::pair<char const *, size_t> const &) const;
+        //The node of the topmost file, for accessing the data
+        node const & operator*() const;
+        node const * operator->() const;
+        operator node() const;
+        //Whether any file below this one has the node too
+        bool overlaid() const;
+        size_t size() const;
+    private:
+        view get_child(char const *, size_t) const;
+        std::vector<node> const & merged() const;
+        node m_node;
+        overlay const * m_overlay {nullptr};
+    };
+    //Stacks nx files on top of each other so that small patch files can shadow a large base file
+    //without rebuilding it
+    class overlay {
+    public:
+        //Takes the nodes to stack, usually the roots of the files, the first one taking precedence and the last one being the base
+        //The files must outlive the overlay and every view obtained from it
+        overlay(std::vector<node> roots);
+        //The merged root of the whole stack
+        view root() const;
+        //The node at the same path as the given node of any file in the stack, seen through the whole stack
+        view find(node) const;
+        //The node at the same path in the files below, or a null node if none of them have it
+        node below(node) const;
+        //Whether the node is at a path the stack covers
+        bool contains(node) const;
+    private:
+        struct layer {
+            file const * source;
+            //The root of the file, which the nodes are indexed from
+            node_data const * root;
+            //The node below each node of this file, computed once up front
+            std::vector<node> below;
+        };
+        overlay(overlay const &);//Todo: Replace with = delete once VS has support for it.
+        overlay & operator=(overlay const &);//Todo: Replace with = delete once VS has support for it.
+        void link(layer &, node, view);
+        //The children of every file merged together, sorted by name with the topmost file winning
+        void merge(node);
+        std::vector<layer> m_layers;
+        node m_root;
+        file const * m_base;
+        //The topmost node for every node that something shadows
+        std::unordered_map<node_data const *, node> m_above;
+        //The merged children of every node that shadows another, which never change once the files are linked
+        std::unordered_map<node_data const *, std::vector<node>> m_merged;
+        friend class view;
+    };
+}
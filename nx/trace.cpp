@@ -0,0 +1,209 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNx - Part of the NoLifeStory project                               //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#include "trace.hpp"
+#include "file.hpp"
+#include "node.hpp"
+#include "bitmap.hpp"
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+//Only plain pointers are needed per thread, which every compiler supports even without thread_local
+#ifdef _WIN32
+#  define NL_THREAD_LOCAL __declspec(thread)
+#else
+#  define NL_THREAD_LOCAL __thread
+#endif
+
+namespace nl {
+    namespace trace {
+        struct slot {
+            file const * source;
+            uint32_t index;
+            event kind;
+        };
+        uint32_t const buffer_size {0x4000};
+        struct buffer {
+            uint32_t thread;
+            uint32_t count;
+            slot slots[buffer_size];
+        };
+        std::atomic<bool> active {false};
+        //Bumped by every start, so threads notice their buffer belongs to an earlier trace
+        std::atomic<uint32_t> generation {0};
+        NL_THREAD_LOCAL buffer * local {nullptr};
+        NL_THREAD_LOCAL uint32_t local_generation {0};
+        std::mutex mutex {};
+        std::condition_variable wake {};
+        //Buffers threads are still filling, and full ones waiting to be written
+        std::vector<buffer *> filling {};
+        std::vector<buffer *> full {};
+        uint32_t thread_count {0};
+        bool stopping {false};
+        std::thread flusher {};
+        std::ofstream out {};
+        //Everything the trace refers to, by file
+        std::unordered_map<file const *, uint8_t> files {};
+        std::vector<file const *> file_order {};
+        std::vector<std::unordered_set<uint32_t>> seen_nodes {};
+        std::vector<std::unordered_set<uint32_t>> seen_bitmaps {};
+        //Set by the flusher when it drops the events of a file past the 256 a trace can number,
+        //since throwing there would take down the whole process
+        bool overflowed {false};
+        //Only ever called by one thread at a time, either the flusher or stop
+        void write(buffer const & b) {
+            std::vector<entry> records {};
+            records.reserve(b.count);
+            for (uint32_t i {0}; i < b.count; ++i) {
+                slot const & e {b.slots[i]};
+                auto const it = files.emplace(e.source, static_cast<uint8_t>(files.size()));
+                if (it.second) {
+                    if (files.size() > 0x100) {
+                        files.erase(it.first);
+                        overflowed = true;
+                        continue;
+                    }
+                    file_order.push_back(e.source);
+                    seen_nodes.emplace_back();
+                    seen_bitmaps.emplace_back();
+                }
+                uint8_t const f {it.first->second};
+                (e.kind == event::bitmap ? seen_bitmaps : seen_nodes)[f].insert(e.index);
+                records.push_back({e.kind, f, 0, e.index});
+            }
+            chunk const c {b.thread, static_cast<uint32_t>(records.size())};
+            out.write(reinterpret_cast<char const *>(&c), sizeof(c));
+            out.write(reinterpret_cast<char const *>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(entry)));
+        }
+        void flush() {
+            std::unique_lock<std::mutex> lock {mutex};
+            for (;;) {
+                wake.wait(lock, [] { return stopping || !full.empty(); });
+                if (full.empty()) return;
+                std::vector<buffer *> todo {};
+                todo.swap(full);
+                lock.unlock();
+                for (buffer * b : todo) {
+                    write(*b);
+                    delete b;
+                }
+                lock.lock();
+            }
+        }
+        buffer * take_buffer() {
+            buffer * const b {new buffer};
+            b->count = 0;
+            std::lock_guard<std::mutex> lock {mutex};
+            b->thread = local_generation == generation ? local->thread : thread_count++;
+            filling.push_back(b);
+            return b;
+        }
+        void start(std::string name) {
+            if (active) throw std::runtime_error {"A trace is already being recorded"};
+            out.open(name, std::ios::binary | std::ios::trunc);
+            if (!out) throw std::runtime_error {"Failed to open file " + name};
+            out.write(reinterpret_cast<char const *>(&magic), sizeof(magic));
+            files.clear();
+            file_order.clear();
+            seen_nodes.clear();
+            seen_bitmaps.clear();
+            overflowed = false;
+            thread_count = 0;
+            stopping = false;
+            ++generation;
+            flusher = std::thread {flush};
+            active = true;
+        }
+        void record(event kind, file const * source, uint32_t index) {
+            if (local_generation != generation || !local) {
+                local = take_buffer();
+                local_generation = generation;
+            }
+            local->slots[local->count++] = {source, index, kind};
+            if (local->count < buffer_size) return;
+            buffer * const next {take_buffer()};
+            {
+                std::lock_guard<std::mutex> lock {mutex};
+                for (size_t i {0}; i < filling.size(); ++i) if (filling[i] == local) {
+                    filling[i] = filling.back();
+                    filling.pop_back();
+                    break;
+                }
+                full.push_back(local);
+            }
+            wake.notify_one();
+            local = next;
+        }
+        //Finds the path of every node and bitmap of the file the trace refers to
+        void write_paths(node n, uint8_t f, node_data const * root, std::vector<std::pair<char const *, size_t>> & names) {
+            uint32_t const index {static_cast<uint32_t>(n.m_data - root)};
+            std::vector<std::pair<event, uint32_t>> found {};
+            if (seen_nodes[f].erase(index)) found.emplace_back(event::lookup, index);
+            if (n.data_type() == node::type::bitmap) {
+                uint32_t const b {n.get_bitmap().m_index};
+                if (seen_bitmaps[f].erase(b)) found.emplace_back(event::bitmap, b);
+            }
+            for (auto const & e : found) {
+                path const p {e.first, f, static_cast<uint16_t>(names.size()), e.second};
+                out.write(reinterpret_cast<char const *>(&p), sizeof(p));
+                for (auto const & name : names) {
+                    uint16_t const length {static_cast<uint16_t>(name.second)};
+                    out.write(reinterpret_cast<char const *>(&length), sizeof(length));
+                    out.write(name.first, static_cast<std::streamsize>(name.second));
+                }
+            }
+            for (node c : n) {
+                names.push_back(c.name_fast());
+                write_paths(c, f, root, names);
+                names.pop_back();
+            }
+        }
+        void stop() {
+            if (!active) return;
+            active = false;
+            {
+                std::lock_guard<std::mutex> lock {mutex};
+                stopping = true;
+            }
+            wake.notify_one();
+            flusher.join();
+            for (buffer * b : filling) {
+                write(*b);
+                delete b;
+            }
+            filling.clear();
+            //Threads notice their buffer is gone by the generation changing on the next start
+            local = nullptr;
+            chunk const c {0, end};
+            out.write(reinterpret_cast<char const *>(&c), sizeof(c));
+            for (size_t f {0}; f < file_order.size(); ++f) {
+                node const root {*file_order[f]};
+                std::vector<std::pair<char const *, size_t>> names {};
+                write_paths(root, static_cast<uint8_t>(f), root.m_data, names);
+            }
+            out.close();
+            if (overflowed) throw std::runtime_error {"Too many files in one trace, the accesses to the rest were left out"};
+        }
+    }
+}
@@ -0,0 +1,77 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNx - Part of the NoLifeStory project                               //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace nl {
+    class file;
+    //An opt-in recorder of how the nx files are accessed, for tuning their layout against real workloads
+    //Each thread fills a buffer of its own and hands it to a background thread to be written out once full,
+    //so recording costs a few stores per event and threads never wait on each other or the disk
+    //NoLifeNxBench can replay the trace against any nx file with the same content
+    namespace trace {
+        enum class event : uint8_t {
+            //A child was found by name, index is the child
+            lookup = 1,
+            //The children of a node were iterated, index is the node
+            visit = 2,
+            //The pixels of a bitmap were requested, index is the bitmap
+            bitmap = 3,
+        };
+        //A trace starts with the magic, followed by chunks that each start with a chunk header
+        //and hold count entries in the order one thread recorded them
+        //A chunk header with a count of end marks the start of the path table, which runs to the end of the trace
+        //and has a path for every node and bitmap the entries refer to
+        uint32_t const magic {0x3154584E};//NXT1
+        uint32_t const end {0xFFFFFFFF};
+#pragma pack(push, 1)
+        struct chunk {
+            uint32_t thread;
+            uint32_t count;
+        };
+        //The file is numbered in the order files first show up in the trace
+        struct entry {
+            event kind;
+            uint8_t file;
+            uint16_t reserved;
+            uint32_t index;
+        };
+        //Followed by count names, each being a 16 bit length and that many bytes, leading from the root to the node
+        //Bitmaps get the path of one of the nodes using them
+        struct path {
+            event kind;
+            uint8_t file;
+            uint16_t count;
+            uint32_t index;
+        };
+#pragma pack(pop)
+        //Checked before recording anything, so that nothing but this load is paid while not recording
+        extern std::atomic<bool> active;
+        //Starts writing a trace to the file, replacing it if it exists
+        //Only call this while no other trace is being recorded
+        void start(std::string name);
+        //Writes whatever is still buffered and the path table, then closes the trace
+        //Every file that was accessed has to still be open, and no other thread may be accessing them
+        //Throws once the trace is closed if more than 256 files were accessed, the trace only covering the first 256
+        void stop();
+        void record(event, file const *, uint32_t index);
+    }
+}
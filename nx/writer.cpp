@@ -0,0 +1,406 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNx - Part of the NoLifeStory project                               //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#include "writer.hpp"
+#include "node.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace nl {
+    uint64_t nx_writer::payload_hash(void const * data, size_t size) {
+        uint8_t const * p {reinterpret_cast<uint8_t const *>(data)};
+        uint64_t hash {14695981039346656037ULL};
+        for (size_t i {0}; i < size; ++i) {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+    //The header and extension header are written last, so the payloads start right after the space left for them
+    nx_writer::nx_writer(std::string name) : m_name {name}, m_end {0x50}, m_nodes(1), m_front_coded {false}, m_pack_arrays {false}, m_layout {layout::insertion} {
+        m_file.open(name, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!m_file) throw std::runtime_error {"Failed to open file " + name};
+        std::memset(&m_nodes[0], 0, sizeof(node_record));
+        add_string("", 0);
+    }
+    nx_writer::~nx_writer() {}
+    nx_writer::node_record & nx_writer::get(node_id n) {
+        if (n >= m_nodes.size()) throw std::runtime_error {"Invalid node id"};
+        return m_nodes[n];
+    }
+    nx_writer::node_id nx_writer::add_nodes(uint32_t count) {
+        node_id const first {static_cast<node_id>(m_nodes.size())};
+        node_record r;
+        std::memset(&r, 0, sizeof(r));
+        m_nodes.resize(m_nodes.size() + count, r);
+        return first;
+    }
+    nx_writer::node_id nx_writer::add_children(node_id parent, uint16_t count) {
+        if (get(parent).num) throw std::runtime_error {"Node already has children"};
+        node_id const first {add_nodes(count)};
+        set_children(parent, first, count);
+        return first;
+    }
+    void nx_writer::set_children(node_id n, node_id first, uint16_t count) {
+        node_record & r {get(n)};
+        r.children = first;
+        r.num = count;
+    }
+    void nx_writer::set_name(node_id n, uint32_t string) {
+        get(n).name = string;
+    }
+    void nx_writer::set_name(node_id n, std::string const & s) {
+        set_name(n, add_string(s));
+    }
+    void nx_writer::set_none(node_id n) {
+        node_record & r {get(n)};
+        r.type = static_cast<uint16_t>(node::type::none);
+        r.ireal = 0;
+    }
+    void nx_writer::set_integer(node_id n, int64_t v) {
+        node_record & r {get(n)};
+        r.type = static_cast<uint16_t>(node::type::integer);
+        r.ireal = v;
+    }
+    void nx_writer::set_real(node_id n, double v) {
+        node_record & r {get(n)};
+        r.type = static_cast<uint16_t>(node::type::real);
+        r.dreal = v;
+    }
+    void nx_writer::set_string(node_id n, uint32_t string) {
+        node_record & r {get(n)};
+        r.type = static_cast<uint16_t>(node::type::string);
+        r.ireal = 0;
+        r.string = string;
+    }
+    void nx_writer::set_string(node_id n, std::string const & s) {
+        set_string(n, add_string(s));
+    }
+    void nx_writer::set_vector(node_id n, int32_t x, int32_t y) {
+        node_record & r {get(n)};
+        r.type = static_cast<uint16_t>(node::type::vector);
+        r.vector[0] = x;
+        r.vector[1] = y;
+    }
+    void nx_writer::set_bitmap(node_id n, uint32_t bitmap, uint16_t width, uint16_t height) {
+        node_record & r {get(n)};
+        r.type = static_cast<uint16_t>(node::type::bitmap);
+        r.bitmap.index = bitmap;
+        r.bitmap.width = width;
+        r.bitmap.height = height;
+    }
+    void nx_writer::set_audio(node_id n, uint32_t audio, uint32_t length) {
+        node_record & r {get(n)};
+        r.type = static_cast<uint16_t>(node::type::audio);
+        r.audio.index = audio;
+        r.audio.length = length;
+    }
+    uint32_t nx_writer::node_count() const {
+        return static_cast<uint32_t>(m_nodes.size());
+    }
+    uint32_t nx_writer::add_string(std::string const & s) {
+        if (s.size() > 0xffff) throw std::runtime_error {"String is too long for an nx file"};
+        auto const it = m_string_ids.emplace(s, static_cast<uint32_t>(m_strings.size()));
+        if (it.second) m_strings.push_back(&it.first->first);
+        return it.first->second;
+    }
+    uint32_t nx_writer::add_string(char const * s, uint16_t size) {
+        return add_string(std::string {s, size});
+    }
+    uint32_t nx_writer::string_count() const {
+        return static_cast<uint32_t>(m_strings.size());
+    }
+    uint64_t nx_writer::append(void const * data, size_t size) {
+        uint64_t const offset {m_end};
+        m_file.seekp(static_cast<std::streamoff>(offset));
+        m_file.write(reinterpret_cast<char const *>(data), static_cast<std::streamsize>(size));
+        if (!m_file) throw std::runtime_error {"Failed to write to file " + m_name};
+        m_end += size;
+        return offset;
+    }
+    //The gap is never written to, so it reads back as zeroes
+    void nx_writer::pad(uint64_t alignment) {
+        m_end = (m_end + alignment - 1) & ~(alignment - 1);
+    }
+    bool nx_writer::matches(payload const & p, void const * data, uint32_t size) {
+        if (p.size != size) return false;
+        m_compare.resize(size);
+        m_file.seekg(static_cast<std::streamoff>(p.offset));
+        m_file.read(m_compare.data(), size);
+        if (!m_file) throw std::runtime_error {"Failed to read from file " + m_name};
+        return !std::memcmp(m_compare.data(), data, size);
+    }
+    uint32_t nx_writer::add_bitmap(void const * data, uint32_t size, uint16_t width, uint16_t height, bitmap::format format, bitmap::codec codec) {
+        return add_bitmap(data, size, width, height, format, codec, payload_hash(data, size));
+    }
+    uint32_t nx_writer::add_bitmap(void const * data, uint32_t size, uint16_t width, uint16_t height, bitmap::format format, bitmap::codec codec, uint64_t payload) {
+        uint64_t const key {static_cast<uint64_t>(codec) << 48 | static_cast<uint64_t>(format) << 56 | static_cast<uint64_t>(width) << 16 | height};
+        uint64_t const hash {payload ^ key * 0x9E3779B97F4A7C15ULL};
+        auto const range = m_bitmap_hashes.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (m_bitmap_keys[it->second] == key && matches(m_bitmaps[it->second], data, size)) return it->second;
+        }
+        uint32_t const id {static_cast<uint32_t>(m_bitmaps.size())};
+        if (format == bitmap::format::bgra8888 && codec == bitmap::codec::raw) {
+            m_end += 4;
+            pad(0x1000);
+            m_end -= 4;
+        } else pad(0x10);
+        uint64_t const offset {append(&size, 4)};
+        append(data, size);
+        m_bitmaps.push_back({offset + 4, size});
+        m_bitmap_keys.push_back(key);
+        m_bitmap_hashes.emplace(hash, id);
+        return id;
+    }
+    uint32_t nx_writer::bitmap_count() const {
+        return static_cast<uint32_t>(m_bitmaps.size());
+    }
+    uint32_t nx_writer::add_audio(void const * data, uint32_t size) {
+        return add_audio(data, size, payload_hash(data, size));
+    }
+    uint32_t nx_writer::add_audio(void const * data, uint32_t size, uint64_t hash) {
+        auto const range = m_audio_hashes.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (matches(m_audio[it->second], data, size)) return it->second;
+        }
+        uint32_t const id {static_cast<uint32_t>(m_audio.size())};
+        pad(0x10);
+        m_audio.push_back({append(data, size), size});
+        m_audio_hashes.emplace(hash, id);
+        return id;
+    }
+    uint32_t nx_writer::audio_count() const {
+        return static_cast<uint32_t>(m_audio.size());
+    }
+    void nx_writer::add_section(uint32_t tag, uint32_t count, void const * data, size_t size) {
+        pad(0x10);
+        m_sections.push_back({tag, count, append(data, size)});
+    }
+    void nx_writer::front_code_strings() {
+        m_front_coded = true;
+    }
+    void nx_writer::pack_arrays() {
+        m_pack_arrays = true;
+    }
+    void nx_writer::set_layout(layout l) {
+        m_layout = l;
+    }
+    void nx_writer::order_nodes() {
+        std::vector<node_record> ordered {m_nodes[0]};
+        //Where each group of children went, so that groups shared by several nodes are only placed once
+        std::unordered_map<uint32_t, uint32_t> placed {};
+        std::vector<uint32_t> pending {};
+        //Moves the children of a node that is already in its new place right behind everything placed so far
+        auto const place = [&](uint32_t n) {
+            node_record & r {ordered[n]};
+            if (!r.num) return false;
+            auto const it = placed.emplace(r.children, static_cast<uint32_t>(ordered.size()));
+            if (!it.second) {
+                r.children = it.first->second;
+                return false;
+            }
+            uint32_t const old {r.children};
+            uint16_t const num {r.num};
+            r.children = it.first->second;
+            ordered.insert(ordered.end(), m_nodes.begin() + old, m_nodes.begin() + old + num);
+            return true;
+        };
+        if (m_layout == layout::breadth_first) {
+            for (uint32_t n {0}; n < ordered.size(); ++n) place(n);
+        } else {
+            //The nodes whose children haven't been placed yet, last one first
+            pending.push_back(0);
+            while (!pending.empty()) {
+                uint32_t const n {pending.back()};
+                pending.pop_back();
+                if (!place(n)) continue;
+                node_record const & r {ordered[n]};
+                for (uint32_t i {r.num}; i--;) pending.push_back(r.children + i);
+            }
+        }
+        m_nodes.swap(ordered);
+    }
+    void nx_writer::write_arrays() {
+#pragma pack(push, 1)
+        struct array_entry {
+            uint64_t offset;
+            uint32_t count;
+            uint8_t kind;
+            uint8_t reserved[3];
+        };
+#pragma pack(pop)
+        std::vector<array_entry> entries {};
+        //Nodes sharing their children share the array too
+        std::unordered_map<uint32_t, uint32_t> packed {};
+        std::vector<node_record const *> elements {};
+        for (node_record & r : m_nodes) {
+            if (r.type != static_cast<uint16_t>(node::type::none) || r.ireal || r.num < 2) continue;
+            auto const it = packed.find(r.children);
+            if (it != packed.end()) {
+                r.array.index = it->second;
+                r.array.count = r.num;
+                continue;
+            }
+            uint16_t const type {m_nodes[r.children].type};
+            if (type != static_cast<uint16_t>(node::type::integer) && type != static_cast<uint16_t>(node::type::real)
+                && type != static_cast<uint16_t>(node::type::vector)) continue;
+            //The children are sorted by name, so 10 comes before 2 and each one has to be put in its place
+            elements.assign(r.num, nullptr);
+            bool eligible {true};
+            for (uint32_t i {r.children}; i < r.children + r.num && eligible; ++i) {
+                node_record const & c {m_nodes[i]};
+                std::string const & name {*m_strings[c.name]};
+                eligible = c.type == type && !c.num && !name.empty() && name.size() <= 5 && (name[0] != '0' || name.size() == 1);
+                size_t index {0};
+                for (char ch : name) {
+                    if (ch < '0' || ch > '9') eligible = false;
+                    index = index * 10 + static_cast<size_t>(ch - '0');
+                }
+                if (eligible && index < r.num && !elements[index]) elements[index] = &c;
+                else eligible = false;
+            }
+            if (!eligible) continue;
+            pad(0x10);
+            uint64_t const offset {m_end};
+            for (node_record const * c : elements) append(&c->ireal, 8);
+            uint32_t const index {static_cast<uint32_t>(entries.size())};
+            entries.push_back({offset, r.num, static_cast<uint8_t>(type), {0, 0, 0}});
+            packed.emplace(r.children, index);
+            r.array.index = index;
+            r.array.count = r.num;
+        }
+        if (!entries.empty()) add_section(0x59525241, static_cast<uint32_t>(entries.size()), entries.data(), entries.size() * sizeof(array_entry));
+    }
+    //Sorting puts strings sharing a prefix next to each other, and the empty string stays first
+    void nx_writer::sort_strings() {
+        std::vector<uint32_t> order(m_strings.size());
+        for (uint32_t i {0}; i < order.size(); ++i) order[i] = i;
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return *m_strings[a] < *m_strings[b];
+        });
+        std::vector<uint32_t> remap(order.size());
+        for (uint32_t i {0}; i < order.size(); ++i) remap[order[i]] = i;
+        for (node_record & r : m_nodes) {
+            r.name = remap[r.name];
+            if (r.type == static_cast<uint16_t>(node::type::string)) r.string = remap[r.string];
+        }
+        std::vector<std::string const *> sorted(order.size());
+        for (uint32_t i {0}; i < order.size(); ++i) sorted[i] = m_strings[order[i]];
+        m_strings.swap(sorted);
+    }
+    uint64_t nx_writer::write_strings() {
+        pad(0x10);
+        if (!m_front_coded) {
+            uint64_t const string_table_offset {m_end};
+            uint64_t next_string {string_table_offset + m_strings.size() * 8};
+            for (std::string const * s : m_strings) {
+                append(&next_string, 8);
+                next_string += 2 + s->size();
+            }
+            for (std::string const * s : m_strings) {
+                uint16_t const size {static_cast<uint16_t>(s->size())};
+                append(&size, 2);
+                append(s->data(), s->size());
+            }
+            return string_table_offset;
+        }
+        //Each block starts with a whole string, and every other string is stored as the length of the prefix
+        //it shares with the one before it followed by the rest of it
+        uint32_t const blocks {static_cast<uint32_t>((m_strings.size() + 15) / 16)};
+        std::vector<uint32_t> offsets(blocks);
+        std::vector<char> data {};
+        for (size_t i {0}; i < m_strings.size(); ++i) {
+            std::string const & s {*m_strings[i]};
+            size_t shared {0};
+            if (i % 16 == 0) offsets[i / 16] = static_cast<uint32_t>(blocks * 4 + data.size());
+            else {
+                std::string const & p {*m_strings[i - 1]};
+                while (shared < 0xff && shared < s.size() && shared < p.size() && s[shared] == p[shared]) ++shared;
+            }
+            size_t const rest {s.size() - shared};
+            data.push_back(static_cast<char>(shared));
+            if (rest < 0xff) data.push_back(static_cast<char>(rest));
+            else {
+                uint16_t const length {static_cast<uint16_t>(rest)};
+                data.push_back(static_cast<char>(0xff));
+                data.insert(data.end(), reinterpret_cast<char const *>(&length), reinterpret_cast<char const *>(&length) + 2);
+            }
+            data.insert(data.end(), s.begin() + static_cast<std::ptrdiff_t>(shared), s.end());
+        }
+        uint64_t const offset {append(offsets.data(), offsets.size() * 4)};
+        append(data.data(), data.size());
+        m_sections.push_back({0x32525453, static_cast<uint32_t>(m_strings.size()), offset});
+        return offset;
+    }
+    void nx_writer::finish() {
+        for (node_record const & r : m_nodes) {
+            if (static_cast<uint64_t>(r.children) + r.num > m_nodes.size()) throw std::runtime_error {"Node children out of range"};
+            if (r.name >= m_strings.size()) throw std::runtime_error {"Node name out of range"};
+        }
+        //Nodes sharing children would sort the same range more than once, which does no harm
+        for (node_record const & r : m_nodes) if (r.num > 1) {
+            std::sort(m_nodes.begin() + r.children, m_nodes.begin() + r.children + r.num, [this](node_record const & a, node_record const & b) {
+                std::string const & sa {*m_strings[a.name]};
+                std::string const & sb {*m_strings[b.name]};
+                int const n {std::memcmp(sa.data(), sb.data(), std::min(sa.size(), sb.size()))};
+                return n < 0 || (n == 0 && sa.size() < sb.size());
+            });
+        }
+        if (m_layout != layout::insertion) order_nodes();
+        if (m_pack_arrays) write_arrays();
+        if (m_front_coded) sort_strings();
+        pad(0x10);
+        uint64_t const node_offset {append(m_nodes.data(), m_nodes.size() * sizeof(node_record))};
+        uint64_t const string_table_offset {write_strings()};
+        pad(0x10);
+        uint64_t const bitmap_table_offset {m_end};
+        for (size_t i {0}; i < m_bitmaps.size(); ++i) {
+            uint64_t const entry {(m_bitmaps[i].offset - 4) | (m_bitmap_keys[i] & 0xffff000000000000ULL)};
+            append(&entry, 8);
+        }
+        pad(0x10);
+        uint64_t const audio_table_offset {m_end};
+        for (payload const & a : m_audio) append(&a.offset, 8);
+        pad(0x10);
+        uint64_t const section_offset {append(m_sections.data(), m_sections.size() * sizeof(section))};
+        m_end = 0;
+        uint32_t const magic {0x34474B50};
+        uint32_t const node_count {static_cast<uint32_t>(m_nodes.size())};
+        uint32_t const string_count {static_cast<uint32_t>(m_strings.size())};
+        uint32_t const bitmap_count {static_cast<uint32_t>(m_bitmaps.size())};
+        uint32_t const audio_count {static_cast<uint32_t>(m_audio.size())};
+        uint32_t const extension_magic {0x3158584E};
+        uint32_t const section_count {static_cast<uint32_t>(m_sections.size())};
+        append(&magic, 4);
+        append(&node_count, 4);
+        append(&node_offset, 8);
+        append(&string_count, 4);
+        append(&string_table_offset, 8);
+        append(&bitmap_count, 4);
+        append(&bitmap_table_offset, 8);
+        append(&audio_count, 4);
+        append(&audio_table_offset, 8);
+        append(&extension_magic, 4);
+        append(&section_count, 4);
+        append(&section_offset, 8);
+        m_file.close();
+        if (!m_file) throw std::runtime_error {"Failed to write to file " + m_name};
+    }
+}
@@ -0,0 +1,172 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNx - Part of the NoLifeStory project                               //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "bitmap.hpp"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace nl {
+    //Builds an nx file piece by piece
+    //Bitmaps, audio and extra sections go straight to disk as they are added,
+    //so only the nodes and strings are ever held in memory
+    //Identical bitmaps and audio are only stored once
+    //The file is not valid until finish() has been called
+    class nx_writer {
+    public:
+        typedef uint32_t node_id;
+        //The order finish() writes the nodes in, the children of each node always being kept together
+        enum class layout {
+            //The order the nodes were added in
+            insertion,
+            //Every subtree is contiguous, with the children of each node followed by the subtree of each child in turn,
+            //so reading one img only touches the pages of that img
+            depth_first,
+            //Level by level, keeping the nodes near the root together
+            breadth_first,
+        };
+        nx_writer(std::string name);
+        //Does not finish the file, so a file that was never finished is left incomplete
+        ~nx_writer();
+        //The root node always exists and has id 0
+        //Adds count nodes that have no name, data or children yet and returns the id of the first one
+        node_id add_nodes(uint32_t count);
+        //Adds count nodes as the children of parent and returns the id of the first one
+        node_id add_children(node_id parent, uint16_t count);
+        //Makes the count nodes starting at first the children of the node
+        //Several nodes may share the same children
+        void set_children(node_id, node_id first, uint16_t count);
+        void set_name(node_id, uint32_t string);
+        void set_name(node_id, std::string const &);
+        void set_none(node_id);
+        void set_integer(node_id, int64_t);
+        void set_real(node_id, double);
+        void set_string(node_id, uint32_t string);
+        void set_string(node_id, std::string const &);
+        void set_vector(node_id, int32_t x, int32_t y);
+        void set_bitmap(node_id, uint32_t bitmap, uint16_t width, uint16_t height);
+        void set_audio(node_id, uint32_t audio, uint32_t length);
+        uint32_t node_count() const;
+        //Returns the id of the string, adding it if it isn't in the file yet
+        //The empty string always has id 0
+        uint32_t add_string(std::string const &);
+        uint32_t add_string(char const *, uint16_t);
+        uint32_t string_count() const;
+        //Returns the id of the bitmap, which is that of an earlier one if the payload and dimensions are identical
+        //size is the size of the encoded data, not including the size prefix stored before it
+        //Raw BGRA bitmaps start on a page boundary so that bitmap::zero_copy() can hand them out directly
+        uint32_t add_bitmap(void const * data, uint32_t size, uint16_t width, uint16_t height, bitmap::format, bitmap::codec);
+        //Takes the payload_hash of the data if it is already known, so it can be computed up front on other threads
+        uint32_t add_bitmap(void const * data, uint32_t size, uint16_t width, uint16_t height, bitmap::format, bitmap::codec, uint64_t hash);
+        uint32_t bitmap_count() const;
+        //Returns the id of the audio, which is that of an earlier one if the payload is identical
+        uint32_t add_audio(void const * data, uint32_t size);
+        uint32_t add_audio(void const * data, uint32_t size, uint64_t hash);
+        uint32_t audio_count() const;
+        //The hash used to find identical payloads
+        static uint64_t payload_hash(void const * data, size_t size);
+        //Adds an extension section of count entries, listed in the section directory under tag
+        void add_section(uint32_t tag, uint32_t count, void const * data, size_t size);
+        //Stores the strings sorted and front coded in small blocks instead of the plain string table,
+        //which is much smaller as sibling names share long prefixes
+        //Only readers that know the front coded string section can read such a file
+        void front_code_strings();
+        //Also stores the children of every node that has no data and whose children are named 0, 1, 2...
+        //and all hold integers, reals or vectors packed together, for node::get_array()
+        //The children stay as they are, so the file remains readable by older readers
+        void pack_arrays();
+        //Defaults to layout::insertion
+        //The node ids handed out before are meaningless afterwards, which doesn't matter as they aren't used past finish()
+        void set_layout(layout);
+        //Sorts the children of every node by name, as nl::node relies on that to find children,
+        //then writes the node and string tables, the payload tables and the header
+        void finish();
+    private:
+#pragma pack(push, 1)
+        struct node_record {
+            uint32_t name;
+            uint32_t children;
+            uint16_t num;
+            uint16_t type;
+            union {
+                int64_t ireal;
+                double dreal;
+                uint32_t string;
+                int32_t vector[2];
+                struct {
+                    uint32_t index;
+                    uint16_t width;
+                    uint16_t height;
+                } bitmap;
+                struct {
+                    uint32_t index;
+                    uint32_t length;
+                } audio;
+                struct {
+                    uint32_t index;
+                    uint32_t count;
+                } array;
+            };
+        };
+#pragma pack(pop)
+        struct payload {
+            uint64_t offset;
+            uint32_t size;
+        };
+        struct section {
+            uint32_t tag;
+            uint32_t count;
+            uint64_t offset;
+        };
+        nx_writer(nx_writer const &);//Todo: Replace with = delete once VS has support for it.
+        nx_writer & operator=(nx_writer const &);//Todo: Replace with = delete once VS has support for it.
+        node_record & get(node_id);
+        uint64_t append(void const *, size_t);
+        void pad(uint64_t alignment);
+        //Compares against the payload already written at that offset
+        bool matches(payload const &, void const *, uint32_t);
+        //Renumbers the nodes in the order of the layout, leaving out any that can't be reached from the root
+        void order_nodes();
+        //Finds the nodes that can be packed and writes their arrays along with the section listing them
+        void write_arrays();
+        //Renumbers the strings in sorted order, for front coding
+        void sort_strings();
+        //Writes the plain string table or the front coded section, returning the offset for the header
+        uint64_t write_strings();
+        std::fstream m_file;
+        std::string m_name;
+        uint64_t m_end;
+        std::vector<node_record> m_nodes;
+        std::unordered_map<std::string, uint32_t> m_string_ids;
+        std::vector<std::string const *> m_strings;
+        std::vector<payload> m_bitmaps;
+        //The codec and format bits of each bitmap table entry, with the dimensions in the low bits
+        std::vector<uint64_t> m_bitmap_keys;
+        std::vector<payload> m_audio;
+        std::unordered_multimap<uint64_t, uint32_t> m_bitmap_hashes;
+        std::unordered_multimap<uint64_t, uint32_t> m_audio_hashes;
+        std::vector<section> m_sections;
+        std::vector<char> m_compare;
+        bool m_front_coded;
+        bool m_pack_arrays;
+        layout m_layout;
+    };
+}
@@ -19,21 +19,53 @@
 #include <nx/node.hpp>
 #include <nx/file.hpp>
 #include <nx/bitmap.hpp>
+#include <nx/audio.hpp>
+#include <nx/lz4.hpp>
+#include <nx/trace.hpp>
 #include <cstdio>
+#include <cstring>
+#include <string>
+#include <set>
 #include <vector>
 #include <algorithm>
 #include <numeric>
 #include <cstddef>
 #include <functional>
+#include <random>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <atomic>
 #ifdef _WIN32
 #  include <Windows.h>
+#  include <Psapi.h>
 #else
 #  include <ctime>
+#  include <sys/resource.h>
+#  include <unistd.h>
+#endif
+#ifdef __linux__
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#endif
+#ifdef NX_ZSTD
+#  include <zstd.h>
 #endif
 
 namespace nl {
-    std::string const filename {"Data.nx"};
-    file const nxfile {filename};
+    std::string filename {"Data.nx"};
+    std::unique_ptr<file> nxfile {};
+    //How many times each benchmark runs, 0 leaving it to each benchmark
+    size_t runs {0};
+    size_t thread_count {std::max<size_t>(std::thread::hardware_concurrency(), 1)};
+    //Evicts the file from memory before every run, to measure a cold start instead of a warm page cache
+    bool cold {false};
+    //The files cold evicts
+    std::vector<file const *> cold_files {};
     size_t load() {
         return file {filename}.node_count();
     }
@@ -46,20 +78,107 @@ namespace nl {
         return recurse_sub(file {filename});
     }
     size_t recurse() {
-        return recurse_sub(nxfile);
+        return recurse_sub(*nxfile);
+    }
+    //Looks every node up by name in its parent, which should always find the node itself
+    size_t recurse_search_sub(node n) {
+        size_t c {1};
+        for (node nn : n) c += n[nn.name_fast()] == nn ? recurse_search_sub(nn) : 0;
+        return c;
+    }
+    size_t recurse_search() {
+        return recurse_search_sub(*nxfile);
+    }
+    //Node layouts only matter when the access jumps around the file, so these visit things in a shuffled order
+    std::vector<std::vector<std::pair<char const *, size_t>>> lookup_paths {};
+    std::vector<node> imgs {};
+    //Nodes with children named 0, 1, 2..., looked up the way animations and lists are read
+    std::vector<node> numbered {};
+    std::vector<node> strings {};
+    std::vector<node> sounds {};
+    std::vector<node> bitmaps {};
+    void collect_sub(node n, std::vector<std::pair<char const *, size_t>> & path, size_t & counter, size_t stride) {
+        std::pair<char const *, size_t> const name {n.name_fast()};
+        if (name.second > 4 && !std::memcmp(name.first + name.second - 4, ".img", 4)) imgs.push_back(n);
+        if (n.size() && n["0"]) numbered.push_back(n);
+        switch (n.data_type()) {
+        case node::type::string: strings.push_back(n); break;
+        case node::type::audio: sounds.push_back(n); break;
+        case node::type::bitmap: bitmaps.push_back(n); break;
+        default: break;
+        }
+        if (counter++ % stride == 0) lookup_paths.push_back(path);
+        for (node nn : n) {
+            path.push_back(nn.name_fast());
+            collect_sub(nn, path, counter, stride);
+            path.pop_back();
+        }
+    }
+    //Samples up to 0x10000 paths spread evenly over the file
+    void collect() {
+        if (!lookup_paths.empty()) return;
+        std::vector<std::pair<char const *, size_t>> path {};
+        size_t counter {0};
+        collect_sub(*nxfile, path, counter, nxfile->node_count() / 0x10000 + 1);
+        std::mt19937 engine {0};
+        std::shuffle(lookup_paths.begin(), lookup_paths.end(), engine);
+        std::shuffle(imgs.begin(), imgs.end(), engine);
+        //Bitmaps used by several nodes are only decoded once per run
+        std::set<size_t> seen {};
+        bitmaps.erase(std::remove_if(bitmaps.begin(), bitmaps.end(), [&seen](node const & n) {
+            return !seen.insert(n.get_bitmap().id()).second;
+        }), bitmaps.end());
+    }
+    //Starts at a different path for each thread so they don't all walk the same nodes in lockstep
+    size_t lookup_from(size_t first) {
+        size_t c {0};
+        for (size_t i {0}; i < lookup_paths.size(); ++i) {
+            node n {*nxfile};
+            for (auto const & name : lookup_paths[(first + i) % lookup_paths.size()]) n = n[name];
+            c += n ? 1 : 0;
+        }
+        return c;
+    }
+    size_t lookup() {
+        return lookup_from(0);
+    }
+    size_t lookup_threads() {
+        std::atomic<size_t> c {0};
+        std::vector<std::thread> threads {};
+        for (size_t t {0}; t < thread_count; ++t) threads.emplace_back([&c, t] {
+            c += lookup_from(lookup_paths.size() * t / thread_count);
+        });
+        for (std::thread & t : threads) t.join();
+        return c;
+    }
+    size_t lookup_numbered() {
+        size_t c {0};
+        for (node const & n : numbered) for (size_t i {0}; i < n.size(); ++i) c += n[i] ? 1 : 0;
+        return c;
     }
-    void recurse_search_sub(node n) {
-        for (node nn : n) n[nn.name_fast()] == nn ? recurse_search_sub(nn) : throw;
+    size_t access_strings() {
+        size_t c {0};
+        for (node const & n : strings) c += n.get_string().size();
+        return c;
     }
-    void recurse_search() {
-        recurse_search_sub(nxfile);
+    size_t access_audio() {
+        size_t c {0};
+        for (node const & n : sounds) {
+            audio const a {n.get_audio()};
+            uint8_t const * const p {reinterpret_cast<uint8_t const *>(a.data())};
+            c += a.length() ? p[0] + p[a.length() - 1] : 0;
+        }
+        return c;
     }
-    void recurse_decompress_sub(node n) {
-        n.get_bitmap().data();
-        for (node nn : n) recurse_decompress_sub(nn);
+    size_t decompress() {
+        size_t c {0};
+        for (node const & n : bitmaps) c += n.get_bitmap().data() ? 1 : 0;
+        return c;
     }
-    void recurse_decompress() {
-        recurse_decompress_sub(nxfile);
+    size_t traverse_imgs() {
+        size_t c {0};
+        for (node const & n : imgs) c += recurse_sub(n);
+        return c;
     }
 #ifdef _WIN32
     double frequency;
@@ -81,37 +200,635 @@ namespace nl {
     }
     void setup_time() {}
 #endif
+    struct usage {
+        size_t minor_faults;
+        size_t major_faults;
+        //Resident set size in KiB
+        int64_t rss;
+    };
+    //Windows doesn't tell minor and major faults apart, so it counts them all as minor
+    usage sample() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS c {};
+        GetProcessMemoryInfo(GetCurrentProcess(), &c, sizeof(c));
+        return {c.PageFaultCount, 0, static_cast<int64_t>(c.WorkingSetSize / 1024)};
+#else
+        struct rusage u;
+        getrusage(RUSAGE_SELF, &u);
+        //ru_maxrss is only the peak, so the current size comes from /proc where there is one
+        int64_t rss {static_cast<int64_t>(u.ru_maxrss)};
+        if (std::FILE * const f = std::fopen("/proc/self/statm", "r")) {
+            long size {0}, resident {0};
+            if (std::fscanf(f, "%ld %ld", &size, &resident) == 2) rss = resident * (sysconf(_SC_PAGESIZE) / 1024);
+            std::fclose(f);
+        }
+        return {static_cast<size_t>(u.ru_minflt), static_cast<size_t>(u.ru_majflt), rss};
+#endif
+    }
+    //Hardware performance counters, each summed over every run of a benchmark
+    //Containers and virtual machines often don't expose them, in which case they read as unavailable
+    class counters {
+    public:
+        static size_t const count = 6;
+        counters() {
+            for (size_t i {0}; i < count; ++i) m_fds[i] = -1;
+#ifdef __linux__
+            uint64_t const cache_miss {PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16};
+            std::pair<uint32_t, uint64_t> const events[count] {
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | cache_miss},
+                {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | cache_miss},
+                {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | cache_miss},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            };
+            for (size_t i {0}; i < count; ++i) {
+                perf_event_attr a {};
+                a.size = sizeof(a);
+                a.type = events[i].first;
+                a.config = events[i].second;
+                a.disabled = 1;
+                //Counts the threads of the MT benchmark too
+                a.inherit = 1;
+                //Most systems only let users count their own code
+                a.exclude_kernel = 1;
+                a.exclude_hv = 1;
+                //There are usually fewer hardware counters than events, so they take turns and get scaled up
+                a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                m_fds[i] = static_cast<int>(syscall(__NR_perf_event_open, &a, 0, -1, -1, 0));
+            }
+#endif
+        }
+        ~counters() {
+#ifdef __linux__
+            for (int fd : m_fds) if (fd != -1) close(fd);
+#endif
+        }
+        bool available() const {
+            return std::any_of(m_fds, m_fds + count, [](int fd) { return fd != -1; });
+        }
+        void reset() {
+#ifdef __linux__
+            for (int fd : m_fds) if (fd != -1) ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+#endif
+        }
+        void start() {
+#ifdef __linux__
+            for (int fd : m_fds) if (fd != -1) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+        }
+        void stop() {
+#ifdef __linux__
+            for (int fd : m_fds) if (fd != -1) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+        }
+        //Returns a negative value for counters that aren't available
+        double read(size_t i) const {
+#ifdef __linux__
+            uint64_t v[3] {};
+            if (m_fds[i] == -1 || ::read(m_fds[i], v, sizeof(v)) != sizeof(v)) return -1;
+            return v[2] ? static_cast<double>(v[0]) * v[1] / v[2] : 0;
+#else
+            return -1;
+#endif
+        }
+        static char const * name(size_t i) {
+            static char const * const names[count] {"cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses"};
+            return names[i];
+        }
+    private:
+        counters(counters const &);//Todo: Replace with = delete once VS has support for it.
+        counters & operator=(counters const &);//Todo: Replace with = delete once VS has support for it.
+        int m_fds[count];
+    };
+    //Only created with --counters
+    std::unique_ptr<counters> perf {};
+    struct result {
+        std::string name;
+        size_t runs;
+        double best, p50, p75, p90, p99, worst, mean;
+        size_t answer;
+        //Averages over every run
+        double minor_faults, major_faults, rss_growth;
+        //Each counter divided by the answer of every run, so per node, lookup or bitmap, negative if unavailable
+        std::vector<double> counters;
+    };
+    std::vector<result> results {};
+    //How one workload fared on some number of threads at once
+    struct scaling_result {
+        std::string name;
+        size_t threads;
+        size_t operations;
+        double per_second;
+        //Throughput relative to one thread, and that divided by the number of threads
+        double speedup, efficiency;
+        //Latencies of single operations in microseconds
+        double p50, p99, p999, worst;
+    };
+    std::vector<scaling_result> scaling {};
+    double percentile(std::vector<double> const & sorted, double p) {
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * (sorted.size() - 1) + 0.5))];
+    }
+    void print_header() {
+        std::printf("Name\t75%%t\tM50%%\tBest\tAnswer\tMinor\tMajor\tRSS KiB");
+        if (perf) std::printf("\tCycles\tInstr\tL1D\tLLC\tdTLB\tBranch");
+        std::printf("\n");
+    }
     void test(std::string name, std::function<size_t()> func, size_t maxruns) {
+        if (runs) maxruns = runs;
         std::vector<double> results {};
         size_t answer {};
+        double minor {0}, major {0}, rss {0};
+        size_t operations {0};
+        if (perf) perf->reset();
         while (maxruns--) {
+            if (cold) for (file const * f : cold_files) f->evict();
+            usage const u1 {sample()};
+            if (perf) perf->start();
             double const c1 {get_time()};
             answer = func();
             double const c2 {get_time()};
+            if (perf) perf->stop();
+            usage const u2 {sample()};
+            operations += answer;
             results.emplace_back(c2 - c1);
+            minor += u2.minor_faults - u1.minor_faults;
+            major += u2.major_faults - u1.major_faults;
+            rss += u2.rss - u1.rss;
         }
+        std::vector<double> per_operation {};
+        if (perf) for (size_t i {0}; i < counters::count; ++i) {
+            double const v {perf->read(i)};
+            per_operation.push_back(v < 0 ? v : v / std::max<size_t>(operations, 1));
+        }
+        minor /= results.size();
+        major /= results.size();
+        rss /= results.size();
         std::sort(results.begin(), results.end());
         std::vector<double>::const_iterator const q0 {results.cbegin()};
         std::vector<double>::const_iterator const q4 {results.cend()};
         std::vector<double>::const_iterator const q2 {q0 + (q4 - q0) / 2};
         std::vector<double>::const_iterator const q1 {q0 + (q2 - q0) / 2};
         std::vector<double>::const_iterator const q3 {q2 + (q4 - q2) / 2};
-        std::printf("%s\t%u\t%u\t%u\t%u\n", name.c_str(),
+        std::printf("%s\t%u\t%u\t%u\t%u\t%.0f\t%.0f\t%.0f", name.c_str(),
             static_cast<unsigned>(*q3),
             static_cast<unsigned>(std::accumulate(q1, q3, 0.) / (q3 - q1)),
             static_cast<unsigned>(*q0),
-            static_cast<unsigned>(answer));
+            static_cast<unsigned>(answer),
+            minor, major, rss);
+        for (double v : per_operation) v < 0 ? std::printf("\t-") : std::printf("\t%.2f", v);
+        std::printf("\n");
+        nl::results.push_back({name, results.size(), *q0, percentile(results, .5), percentile(results, .75),
+            percentile(results, .9), percentile(results, .99), results.back(),
+            std::accumulate(q0, q4, 0.) / results.size(), answer, minor, major, rss, per_operation});
     }
-    void bench() {
+    //Times are in microseconds and the resident set size in KiB
+    void write_json(std::string const & name) {
+        std::ofstream out {name};
+        out << "{\"file\":\"" << filename << "\",\"threads\":" << thread_count << ",\"cold\":" << (cold ? "true" : "false")
+            << ",\"results\":[";
+        for (size_t i {0}; i < results.size(); ++i) {
+            result const & r {results[i]};
+            out << (i ? "," : "") << "{\"name\":\"" << r.name << "\",\"runs\":" << r.runs << ",\"best\":" << r.best
+                << ",\"p50\":" << r.p50 << ",\"p75\":" << r.p75 << ",\"p90\":" << r.p90 << ",\"p99\":" << r.p99
+                << ",\"worst\":" << r.worst << ",\"mean\":" << r.mean << ",\"answer\":" << r.answer
+                << ",\"minor_faults\":" << r.minor_faults << ",\"major_faults\":" << r.major_faults
+                << ",\"rss_growth\":" << r.rss_growth;
+            //Counters that aren't available are left out
+            if (perf) {
+                out << ",\"counters\":{";
+                bool first {true};
+                for (size_t j {0}; j < r.counters.size(); ++j) if (r.counters[j] >= 0) {
+                    out << (first ? "" : ",") << "\"" << counters::name(j) << "\":" << r.counters[j];
+                    first = false;
+                }
+                out << "}";
+            }
+            out << "}";
+        }
+        out << "],\"scaling\":[";
+        for (size_t i {0}; i < scaling.size(); ++i) {
+            scaling_result const & r {scaling[i]};
+            out << (i ? "," : "") << "{\"name\":\"" << r.name << "\",\"threads\":" << r.threads << ",\"operations\":" << r.operations
+                << ",\"per_second\":" << r.per_second << ",\"speedup\":" << r.speedup << ",\"efficiency\":" << r.efficiency
+                << ",\"p50\":" << r.p50 << ",\"p99\":" << r.p99 << ",\"p999\":" << r.p999 << ",\"worst\":" << r.worst << "}";
+        }
+        out << "]}" << std::endl;
+    }
+    void write_csv(std::string const & name) {
+        std::ofstream out {name};
+        //The scale mode only has a table of its own
+        if (!results.empty() || scaling.empty()) {
+            out << "name,runs,best,p50,p75,p90,p99,worst,mean,answer,minor_faults,major_faults,rss_growth";
+            if (perf) for (size_t i {0}; i < counters::count; ++i) out << ',' << counters::name(i);
+            out << '\n';
+        }
+        for (result const & r : results) {
+            out << r.name << ',' << r.runs << ',' << r.best << ',' << r.p50 << ',' << r.p75 << ',' << r.p90 << ','
+                << r.p99 << ',' << r.worst << ',' << r.mean << ',' << r.answer << ',' << r.minor_faults << ','
+                << r.major_faults << ',' << r.rss_growth;
+            //Counters that aren't available are left empty
+            for (double v : r.counters) {
+                out << ',';
+                if (v >= 0) out << v;
+            }
+            out << '\n';
+        }
+        if (scaling.empty()) return;
+        out << (results.empty() ? "" : "\n") << "name,threads,operations,per_second,speedup,efficiency,p50,p99,p999,worst\n";
+        for (scaling_result const & r : scaling) {
+            out << r.name << ',' << r.threads << ',' << r.operations << ',' << r.per_second << ',' << r.speedup << ','
+                << r.efficiency << ',' << r.p50 << ',' << r.p99 << ',' << r.p999 << ',' << r.worst << '\n';
+        }
+    }
+    //Re-encodes every BGRA bitmap with each codec to compare file size against decode speed
+    struct codec_result {
+        std::string name;
+        size_t size;
+        double time;
+    };
+    std::vector<codec_result> codec_results {{"raw", 0, 0}, {"lz4", 0, 0}, {"lz4hc", 0, 0},
+#ifdef NX_ZSTD
+        {"zstd", 0, 0},
+#endif
+    };
+    std::set<size_t> codec_seen {};
+    std::vector<uint8_t> codec_pixels {}, codec_packed {}, codec_out {};
+    size_t codec_bytes {0};
+    size_t codec_encode(size_t c, size_t l) {
+        switch (c) {
+        case 0: std::memcpy(codec_packed.data(), codec_pixels.data(), l); return l;
+        case 1: return lz4::compress(codec_pixels.data(), codec_packed.data(), l);
+        case 2: return lz4::compress_hc(codec_pixels.data(), codec_packed.data(), l);
+#ifdef NX_ZSTD
+        case 3: return ZSTD_compress(codec_packed.data(), codec_packed.size(), codec_pixels.data(), l, 19);
+#endif
+        }
+        return 0;
+    }
+    void codec_decode(size_t c, size_t l, size_t csize) {
+        switch (c) {
+        case 0: std::memcpy(codec_out.data(), codec_packed.data(), l); break;
+        case 1:
+        case 2: lz4::uncompress(codec_packed.data(), codec_out.data(), l); break;
+#ifdef NX_ZSTD
+        case 3: ZSTD_decompress(codec_out.data(), l, codec_packed.data(), csize); break;
+#endif
+        }
+        //Only zstd needs the compressed size
+        static_cast<void>(csize);
+    }
+    void bench_codecs_sub(node n) {
+        bitmap const b {n.get_bitmap()};
+        if (b && !b.compressed() && codec_seen.insert(b.id()).second) {
+            size_t const l {b.length()};
+            uint8_t const * const p {reinterpret_cast<uint8_t const *>(b.data())};
+            codec_pixels.assign(p, p + l);
+            codec_packed.resize(lz4::compress_bound(l) + 0x400);
+            codec_out.resize(l + 0x20);
+            codec_bytes += l;
+            for (size_t c {0}; c < codec_results.size(); ++c) {
+                size_t const csize {codec_encode(c, l)};
+                double const c1 {get_time()};
+                codec_decode(c, l, csize);
+                double const c2 {get_time()};
+                codec_results[c].size += csize;
+                codec_results[c].time += c2 - c1;
+            }
+        }
+        for (node nn : n) bench_codecs_sub(nn);
+    }
+    void bench_codecs() {
         setup_time();
-        std::printf("Name\t75%%t\tM50%%\tBest\tAnswer\n");
-        test("Ld", load, 0x1000);
-        test("Re", recurse, 0x40);
-        test("LR", recurse_load, 0x40);
-        //test("SA", recurse_search, 0x40);
-        //test("De", recurse_decompress, 0x10);
+        bench_codecs_sub(*nxfile);
+        std::printf("Codec\tSize\tRatio\tMB/s\n");
+        for (auto const & c : codec_results) {
+            std::printf("%s\t%u\t%.3f\t%.1f\n", c.name.c_str(), static_cast<unsigned>(c.size),
+                codec_bytes ? static_cast<double>(c.size) / codec_bytes : 0.,
+                c.time > 0 ? codec_bytes / c.time : 0.);
+        }
+    }
+    //Replays a trace recorded with nl::trace, against files that may be laid out differently from the ones it was recorded on
+    struct replay_event {
+        trace::event kind;
+        //The parent for lookups, otherwise the node itself
+        node target;
+        std::pair<char const *, size_t> name;
+    };
+    std::vector<char> trace_data {};
+    std::vector<replay_event> replay_events {};
+    size_t replay() {
+        size_t c {0};
+        for (replay_event const & e : replay_events) switch (e.kind) {
+        case trace::event::lookup: c += e.target[e.name] ? 1 : 0; break;
+        case trace::event::visit: for (node n : e.target) c += n.size(); break;
+        case trace::event::bitmap: c += e.target.get_bitmap().data() ? 1 : 0; break;
+        }
+        return c;
+    }
+    //The memory each event touches, roughly, to count the pages and cache lines a layout makes it read
+    void touched(replay_event const & e, std::unordered_set<size_t> & pages, std::unordered_set<size_t> & lines) {
+        auto const add = [&](void const * p, size_t size) {
+            size_t const b {reinterpret_cast<size_t>(p)};
+            for (size_t l {b >> 6}; l <= (b + (size ? size - 1 : 0)) >> 6; ++l) lines.insert(l), pages.insert(l >> 6);
+        };
+        switch (e.kind) {
+        case trace::event::lookup: {
+            add(e.target.begin().m_data, e.target.size() * sizeof(node::data));
+            node const n {e.target[e.name]};
+            std::pair<char const *, size_t> const name {n.name_fast()};
+            add(name.first, name.second);
+            break;
+        }
+        case trace::event::visit: add(e.target.begin().m_data, e.target.size() * sizeof(node::data)); break;
+        case trace::event::bitmap: {
+            bitmap const b {e.target.get_bitmap()};
+            add(b.payload(), b.payload_length());
+            break;
+        }
+        }
+    }
+    void bench_replay(std::string const & name, std::vector<std::string> const & names) {
+        setup_time();
+        std::ifstream in {name, std::ios::binary};
+        trace_data.assign(std::istreambuf_iterator<char> {in}, std::istreambuf_iterator<char> {});
+        char const * p {trace_data.data()};
+        char const * const end {p + trace_data.size()};
+        if (trace_data.size() < 4 || *reinterpret_cast<uint32_t const *>(p) != trace::magic) {
+            std::printf("%s is not a trace\n", name.c_str());
+            return;
+        }
+        p += 4;
+        std::vector<std::pair<trace::entry const *, uint32_t>> chunks {};
+        while (p + sizeof(trace::chunk) <= end) {
+            trace::chunk const c {*reinterpret_cast<trace::chunk const *>(p)};
+            p += sizeof(c);
+            if (c.count == trace::end) break;
+            chunks.emplace_back(reinterpret_cast<trace::entry const *>(p), c.count);
+            p += c.count * sizeof(trace::entry);
+        }
+        //The files to replay against, in the order they first show up in the trace
+        std::vector<std::unique_ptr<file>> opened {};
+        std::vector<node> roots {};
+        if (names.empty()) roots.push_back(*nxfile);
+        for (std::string const & n : names) {
+            opened.emplace_back(new file {n});
+            roots.push_back(*opened.back());
+            cold_files.push_back(opened.back().get());
+        }
+        //Resolve every path in the files, keyed by whether it is a bitmap, the file and the index
+        std::unordered_map<uint64_t, std::pair<node, std::pair<char const *, size_t>>> resolved {};
+        size_t missing {0};
+        while (p + sizeof(trace::path) <= end) {
+            trace::path const h {*reinterpret_cast<trace::path const *>(p)};
+            p += sizeof(h);
+            node parent {}, n {h.file < roots.size() ? roots[h.file] : node {}};
+            std::pair<char const *, size_t> last {nullptr, 0};
+            for (uint16_t i {0}; i < h.count; ++i) {
+                uint16_t const length {*reinterpret_cast<uint16_t const *>(p)};
+                last = {p + 2, length};
+                p += 2 + length;
+                parent = n;
+                n = n[last];
+            }
+            if (!n) {
+                ++missing;
+                continue;
+            }
+            uint64_t const key {static_cast<uint64_t>(h.kind == trace::event::bitmap) << 40 | static_cast<uint64_t>(h.file) << 32 | h.index};
+            resolved.emplace(key, std::make_pair(h.kind == trace::event::bitmap ? n : parent, last));
+        }
+        size_t skipped {0};
+        for (auto const & c : chunks) for (uint32_t i {0}; i < c.second; ++i) {
+            trace::entry const & e {c.first[i]};
+            uint64_t const key {static_cast<uint64_t>(e.kind == trace::event::bitmap) << 40 | static_cast<uint64_t>(e.file) << 32 | e.index};
+            auto const it = resolved.find(key);
+            //The root has no parent to look it up in, and visiting it is still worth replaying
+            if (it == resolved.end() || (e.kind == trace::event::lookup && !it->second.first)) {
+                ++skipped;
+                continue;
+            }
+            if (e.kind == trace::event::visit) {
+                node const target {it->second.second.first ? it->second.first[it->second.second] : roots[e.file]};
+                replay_events.push_back({e.kind, target, {nullptr, 0}});
+            } else replay_events.push_back({e.kind, it->second.first, it->second.second});
+        }
+        std::unordered_set<size_t> pages {}, lines {};
+        for (replay_event const & e : replay_events) touched(e, pages, lines);
+        if (cold) for (file const * f : cold_files) f->evict();
+        usage const u1 {sample()};
+        double const c1 {get_time()};
+        replay();
+        double const c2 {get_time()};
+        usage const u2 {sample()};
+        std::printf("Events\tSkipped\tMissing\tPages\tLines\tFaults\tFirst\n");
+        std::printf("%u\t%u\t%u\t%u\t%u\t%u\t%u\n", static_cast<unsigned>(replay_events.size()), static_cast<unsigned>(skipped),
+            static_cast<unsigned>(missing), static_cast<unsigned>(pages.size()), static_cast<unsigned>(lines.size()),
+            static_cast<unsigned>(u2.minor_faults + u2.major_faults - u1.minor_faults - u1.major_faults), static_cast<unsigned>(c2 - c1));
+        print_header();
+        test("Rp", replay, 0x40);
+    }
+    //Records the standard benchmarks, giving a trace to try replay on without a real workload
+    void bench_record(std::string const & name) {
+        trace::start(name);
+        recurse();
+        collect();
+        lookup();
+        trace::stop();
+    }
+    //Counts latencies in buckets whose width grows with the value, like HdrHistogram,
+    //so any percentile is accurate to within about 3% whatever the range of the values
+    class histogram {
+    public:
+        histogram() : m_counts(bucket_count, 0), m_total {0} {}
+        void record(uint64_t v) {
+            ++m_counts[bucket(v)];
+            ++m_total;
+        }
+        void merge(histogram const & o) {
+            for (size_t i {0}; i < bucket_count; ++i) m_counts[i] += o.m_counts[i];
+            m_total += o.m_total;
+        }
+        //Returns the middle of the bucket the percentile falls in
+        uint64_t percentile(double p) const {
+            uint64_t const rank {static_cast<uint64_t>(p * m_total + .5)};
+            uint64_t seen {0};
+            for (size_t i {0}; i < bucket_count; ++i) if ((seen += m_counts[i]) >= std::max<uint64_t>(rank, 1)) return middle(i);
+            return 0;
+        }
+        uint64_t maximum() const {
+            for (size_t i {bucket_count}; i--;) if (m_counts[i]) return middle(i);
+            return 0;
+        }
+    private:
+        //Values below 64 get a bucket each, then every power of two is split into 32 buckets
+        static size_t const bucket_count = 64 + 59 * 32;
+        static size_t bucket(uint64_t v) {
+            if (v < 64) return static_cast<size_t>(v);
+            size_t shift {1};
+            while (v >> shift >= 64) ++shift;
+            return 64 + (shift - 1) * 32 + static_cast<size_t>((v >> shift) - 32);
+        }
+        static uint64_t middle(size_t i) {
+            if (i < 64) return i;
+            size_t const shift {(i - 64) / 32 + 1};
+            return (static_cast<uint64_t>((i - 64) % 32 + 32) << shift) + (1ull << shift) / 2;
+        }
+        std::vector<uint64_t> m_counts;
+        uint64_t m_total;
+    };
+    //Runs every operation of a workload on each thread at once, each thread starting at a different point,
+    //so any state the threads share shows up as throughput that stops growing with the threads
+    scaling_result scale(std::string const & name, std::function<size_t(size_t)> const & op, size_t count, size_t threads, double single) {
+        std::vector<histogram> histograms(threads);
+        std::atomic<size_t> ready {0}, answer {0};
+        std::atomic<bool> go {false};
+        std::vector<std::thread> workers {};
+        for (size_t t {0}; t < threads; ++t) workers.emplace_back([&, t] {
+            histogram & h {histograms[t]};
+            size_t const first {count * t / threads};
+            size_t a {0};
+            ++ready;
+            while (!go) std::this_thread::yield();
+            for (size_t i {0}; i < count; ++i) {
+                double const c1 {get_time()};
+                a += op((first + i) % count);
+                double const c2 {get_time()};
+                h.record(static_cast<uint64_t>((c2 - c1) * 1000));
+            }
+            answer += a;
+        });
+        while (ready != threads) std::this_thread::yield();
+        double const c1 {get_time()};
+        go = true;
+        for (std::thread & w : workers) w.join();
+        double const c2 {get_time()};
+        for (size_t t {1}; t < threads; ++t) histograms[0].merge(histograms[t]);
+        histogram const & h {histograms[0]};
+        double const per_second {count * threads * 1000000. / std::max(c2 - c1, 1.)};
+        double const speedup {single > 0 ? per_second / single : 1};
+        return {name, threads, count * threads, per_second, speedup, speedup / threads,
+            h.percentile(.5) / 1000., h.percentile(.99) / 1000., h.percentile(.999) / 1000., h.maximum() / 1000.};
+    }
+    //Runs each workload on 1, 2, 4... threads up to thread_count
+    void bench_scaling(std::vector<std::string> const & selected) {
+        setup_time();
+        collect();
+        struct workload {
+            char const * name;
+            std::function<size_t(size_t)> op;
+            size_t count;
+        };
+        std::vector<workload> const workloads {
+            {"Lk", [](size_t i) {
+                node n {*nxfile};
+                for (auto const & name : lookup_paths[i]) n = n[name];
+                return n ? size_t {1} : size_t {0};
+            }, lookup_paths.size()},
+            {"Im", [](size_t i) { return recurse_sub(imgs[i]); }, imgs.size()},
+            {"De", [](size_t i) { return bitmaps[i].get_bitmap().data() ? size_t {1} : size_t {0}; }, bitmaps.size()},
+        };
+        std::vector<size_t> counts {};
+        for (size_t t {1}; t < thread_count; t *= 2) counts.push_back(t);
+        counts.push_back(thread_count);
+        std::printf("Name\tThreads\tOps/s\tSpeedup\tEff%%\tp50us\tp99us\tp999us\tMaxus\n");
+        for (workload const & w : workloads) {
+            if (!selected.empty() && std::find(selected.begin(), selected.end(), w.name) == selected.end()) continue;
+            if (!w.count) continue;
+            double single {0};
+            for (size_t t : counts) {
+                scaling_result const r {scale(w.name, w.op, w.count, t, single)};
+                if (t == 1) single = r.per_second;
+                std::printf("%s\t%u\t%.0f\t%.2f\t%.0f\t%.2f\t%.2f\t%.2f\t%.2f\n", r.name.c_str(), static_cast<unsigned>(r.threads),
+                    r.per_second, r.speedup, r.efficiency * 100, r.p50, r.p99, r.p999, r.worst);
+                scaling.push_back(r);
+            }
+        }
+    }
+    struct benchmark {
+        char const * name;
+        char const * description;
+        std::function<size_t()> func;
+        size_t runs;
+    };
+    std::vector<benchmark> const benchmarks {
+        {"Ld", "open the file", load, 0x1000},
+        {"Re", "iterate over every node", recurse, 0x40},
+        {"LR", "open the file and iterate over every node", recurse_load, 0x40},
+        {"SA", "look up every node by name in its parent", recurse_search, 0x40},
+        {"Lk", "look up sampled paths from the root in a random order", lookup, 0x40},
+        {"Im", "iterate over every img in a random order", traverse_imgs, 0x40},
+        {"Nm", "look up the children of lists by number", lookup_numbered, 0x40},
+        {"St", "read every string", access_strings, 0x40},
+        {"De", "decode every bitmap", decompress, 0x10},
+        {"Au", "read every audio", access_audio, 0x40},
+        {"MT", "look up sampled paths on every thread at once", lookup_threads, 0x40},
+    };
+    void bench(std::vector<std::string> const & selected) {
+        setup_time();
+        collect();
+        print_header();
+        for (benchmark const & b : benchmarks) {
+            if (!selected.empty() && std::find(selected.begin(), selected.end(), b.name) == selected.end()) continue;
+            test(b.name, b.func, b.runs);
+        }
+    }
+    void usage(char const * self) {
+        std::printf("Usage: %s [options] [codecs | scale | record <trace> | replay <trace> [file.nx...]]\n", self);
+        std::printf("  scale runs the Lk, Im and De workloads on 1, 2, 4... threads up to --threads\n");
+        std::printf("  --file <file.nx>  the file to benchmark, Data.nx by default\n");
+        std::printf("  --runs <n>        how many times to run each benchmark\n");
+        std::printf("  --threads <n>     how many threads MT uses, every core by default\n");
+        std::printf("  --bench <a,b,...> which benchmarks to run, all by default\n");
+        std::printf("  --json <file>     also write the results as JSON\n");
+        std::printf("  --csv <file>      also write the results as CSV\n");
+        std::printf("  --cold            evict the file from memory before every run\n");
+        std::printf("  --counters        also count cycles, instructions and misses per node, lookup or bitmap\n");
+        std::printf("Benchmarks, with times in microseconds:\n");
+        for (benchmark const & b : benchmarks) std::printf("  %s  %s\n", b.name, b.description);
     }
 }
-int main() {
-    nl::bench();
+int main(int argc, char ** argv) {
+    std::vector<std::string> args {};
+    std::vector<std::string> selected {};
+    std::string json {}, csv {};
+    for (int i {1}; i < argc; ++i) {
+        std::string const arg {argv[i]};
+        if (arg == "--file" && i + 1 < argc) nl::filename = argv[++i];
+        else if (arg == "--runs" && i + 1 < argc) nl::runs = std::stoul(argv[++i]);
+        else if (arg == "--threads" && i + 1 < argc) nl::thread_count = std::max<size_t>(std::stoul(argv[++i]), 1);
+        else if (arg == "--bench" && i + 1 < argc) {
+            std::string const list {argv[++i]};
+            for (size_t b {0}, e {0}; e != std::string::npos; b = e + 1) {
+                e = list.find(',', b);
+                selected.push_back(list.substr(b, e == std::string::npos ? std::string::npos : e - b));
+            }
+        } else if (arg == "--json" && i + 1 < argc) json = argv[++i];
+        else if (arg == "--csv" && i + 1 < argc) csv = argv[++i];
+        else if (arg == "--cold") nl::cold = true;
+        else if (arg == "--counters") {
+            nl::perf.reset(new nl::counters {});
+            if (!nl::perf->available()) std::printf("Hardware performance counters are not available here\n");
+        }
+        else if (arg == "--help" || arg == "-h") {
+            nl::usage(argv[0]);
+            return 0;
+        } else args.push_back(arg);
+    }
+    nl::nxfile.reset(new nl::file {nl::filename});
+    nl::cold_files.push_back(nl::nxfile.get());
+    std::string const mode {args.empty() ? "" : args[0]};
+    if (mode == "codecs") nl::bench_codecs();
+    else if (mode == "scale") nl::bench_scaling(selected);
+    //record <trace> writes a trace of the standard benchmarks
+    else if (mode == "record" && args.size() > 1) nl::bench_record(args[1]);
+    //replay <trace> [file.nx...] replays a trace against the file, or the given files in the order the trace first used them
+    else if (mode == "replay" && args.size() > 1) nl::bench_replay(args[1], std::vector<std::string> {args.begin() + 2, args.end()});
+    else if (mode.empty()) nl::bench(selected);
+    else {
+        nl::usage(argv[0]);
+        return 1;
+    }
+    if (!json.empty()) nl::write_json(json);
+    if (!csv.empty()) nl::write_csv(csv);
 }
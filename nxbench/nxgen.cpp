@@ -0,0 +1,381 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNxGen - Part of the NoLifeStory project                            //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+//Writes synthetic nx files shaped like the real ones, so benchmarks and layout experiments can run without any game data
+//The same seed always gives the same file, whatever the platform
+#include <nx/writer.hpp>
+#include <nx/lz4.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace nl {
+    //The distributions of <random> differ between standard libraries, so every choice is made from the raw engine output
+    class random {
+    public:
+        random(uint32_t seed) : m_engine {seed} {}
+        double unit() {
+            return m_engine() / 4294967296.;
+        }
+        //Uniform over [low, high]
+        uint32_t between(uint32_t low, uint32_t high) {
+            return low + static_cast<uint32_t>(m_engine() % (static_cast<uint64_t>(high) - low + 1));
+        }
+        //Over [low, high] but mostly near low, like the number of children of real nodes
+        uint32_t skewed(uint32_t low, uint32_t high) {
+            double const u {unit()};
+            return low + static_cast<uint32_t>(u * u * u * (high - low + 1));
+        }
+        bool chance(double p) {
+            return unit() < p;
+        }
+    private:
+        std::mt19937 m_engine;
+    };
+    //What one top level directory of a file looks like
+    struct shape {
+        std::string name;
+        //Levels of directories between this one and the imgs, each with dir_fanout children
+        uint32_t dir_depth;
+        uint32_t dir_fanout;
+        //Imgs in each directory at the bottom, named by number with img_digits digits
+        uint32_t imgs;
+        uint32_t img_digits;
+        //Children of each img, then of every node below it, both skewed towards the minimum
+        uint32_t top_min, top_max;
+        uint32_t fanout_min, fanout_max;
+        //How many levels there can be below each img
+        uint32_t depth;
+        //Chance of a node having children instead of a value, above depth
+        double branch;
+        //Chance of the children of a node being named 0, 1, 2... like frames and lists are
+        //Half of those are all leaves of the same type, which nx_writer::pack_arrays() packs
+        double numbered;
+        //Chance of the children of an img being named by number like the item and mob ids in String.nx are
+        double ids;
+        uint32_t name_min, name_max;
+        //Relative weights of each type of value
+        uint32_t integers, reals, strings, vectors, bitmaps, audio;
+        uint32_t string_min, string_max;
+        //Chance of a string value repeating an earlier one
+        double repeats;
+        //Width and height of bitmaps
+        uint32_t bitmap_min, bitmap_max;
+        //Chance of a bitmap having origin and delay children like canvases do
+        double canvas;
+        uint32_t audio_min, audio_max;
+    };
+    //Presets that imitate the shapes of Map.nx, Character.nx and String.nx
+    std::vector<shape> preset(std::string const & name) {
+        //The tiny preset is only meant for checking things work
+        if (name == "tiny") return {
+            {"Tiny", 1, 3, 4, 9, 2, 8, 1, 6, 4, .5, .3, 0, 2, 8, 40, 5, 20, 10, 10, 2, 4, 16, .5, 4, 32, .8, 256, 1024},
+        };
+        if (name == "map") return {
+            {"Map", 1, 10, 100, 9, 6, 16, 1, 24, 5, .45, .4, 0, 1, 10, 60, 2, 10, 15, 0, 0, 3, 20, .8, 1, 1, 0, 0, 0},
+            {"Obj", 0, 1, 60, 0, 4, 24, 1, 12, 4, .6, .3, 0, 2, 10, 10, 0, 2, 10, 40, 0, 1, 10, .5, 16, 256, .9, 0, 0},
+            {"Tile", 0, 1, 30, 0, 4, 12, 1, 16, 2, .9, .2, 0, 2, 6, 10, 0, 1, 10, 40, 0, 1, 10, .5, 90, 90, .95, 0, 0},
+            {"Back", 0, 1, 40, 0, 2, 4, 1, 24, 3, .5, .6, 0, 1, 6, 10, 0, 1, 10, 40, 0, 1, 10, .5, 64, 512, .8, 0, 0},
+        };
+        if (name == "character") return {
+            {"Weapon", 0, 1, 400, 8, 4, 20, 1, 12, 4, .55, .7, 0, 2, 10, 20, 1, 2, 25, 30, 0, 4, 16, .9, 8, 96, .95, 0, 0},
+            {"Cap", 0, 1, 300, 8, 4, 16, 1, 10, 4, .55, .7, 0, 2, 10, 20, 1, 2, 25, 30, 0, 4, 16, .9, 8, 64, .95, 0, 0},
+            {"Hair", 0, 1, 200, 8, 8, 24, 1, 8, 4, .55, .7, 0, 2, 10, 10, 0, 2, 25, 40, 0, 4, 16, .9, 16, 64, .95, 0, 0},
+            {"Afterimage", 0, 1, 20, 0, 4, 12, 1, 16, 4, .6, .5, 0, 2, 8, 20, 0, 0, 20, 20, 0, 4, 16, .9, 32, 256, .9, 0, 0},
+        };
+        if (name == "string") return {
+            {"", 0, 1, 12, 0, 100, 4000, 1, 6, 2, .85, 0, .9, 1, 8, 2, 0, 60, 0, 0, 0, 4, 120, .2, 1, 1, 0, 0, 0},
+        };
+        throw std::runtime_error {"Unknown preset " + name};
+    }
+    class generator {
+    public:
+        generator(nx_writer & writer, uint32_t seed, double compressibility) :
+            m_writer(writer), m_random {seed}, m_compressibility {compressibility} {}
+        void directory(nx_writer::node_id n, shape const & s, uint32_t level) {
+            if (level < s.dir_depth) {
+                nx_writer::node_id const first {m_writer.add_children(n, static_cast<uint16_t>(s.dir_fanout))};
+                for (uint32_t i {0}; i < s.dir_fanout; ++i) {
+                    m_writer.set_name(first + i, s.name + std::to_string(i));
+                    directory(first + i, s, level + 1);
+                }
+                return;
+            }
+            uint32_t const count {std::max<uint32_t>(std::min<uint32_t>(s.imgs, 0xffff), 1)};
+            nx_writer::node_id const first {m_writer.add_children(n, static_cast<uint16_t>(count))};
+            std::vector<std::string> const names {img_names(s, count)};
+            for (uint32_t i {0}; i < count; ++i) {
+                m_writer.set_name(first + i, names[i]);
+                fill(first + i, s, 0);
+            }
+        }
+    private:
+        std::vector<std::string> img_names(shape const & s, uint32_t count) {
+            if (!s.img_digits) return unique_names(s, count, ".img");
+            std::vector<std::string> names {};
+            uint64_t id {static_cast<uint64_t>(m_random.between(1, 9)) * pow10(s.img_digits - 1)};
+            for (uint32_t i {0}; i < count; ++i) {
+                id += m_random.skewed(1, 1000);
+                std::string name {std::to_string(id)};
+                if (name.size() < s.img_digits) name.insert(0, s.img_digits - name.size(), '0');
+                names.push_back(name + ".img");
+            }
+            return names;
+        }
+        static uint64_t pow10(uint32_t n) {
+            uint64_t r {1};
+            while (n--) r *= 10;
+            return r;
+        }
+        std::string word(uint32_t low, uint32_t high) {
+            uint32_t const length {m_random.between(low, high)};
+            std::string s(length, ' ');
+            for (char & c : s) c = static_cast<char>('a' + m_random.skewed(0, 25));
+            return s;
+        }
+        std::vector<std::string> unique_names(shape const & s, uint32_t count, char const * suffix) {
+            std::set<std::string> seen {};
+            std::vector<std::string> names {};
+            while (names.size() < count) {
+                std::string name {word(s.name_min, s.name_max) + suffix};
+                if (seen.insert(name).second) names.push_back(name);
+                //Short names run out quickly, so fall back to numbering them
+                else if (seen.insert(name += std::to_string(names.size())).second) names.push_back(name);
+            }
+            return names;
+        }
+        void fill(nx_writer::node_id n, shape const & s, uint32_t level) {
+            if (level >= s.depth || (level && !m_random.chance(s.branch))) {
+                value(n, s, pick(s));
+                return;
+            }
+            uint32_t const count {std::min<uint32_t>(level ? m_random.skewed(s.fanout_min, s.fanout_max)
+                : m_random.skewed(s.top_min, s.top_max), 0xffff)};
+            nx_writer::node_id const first {m_writer.add_children(n, static_cast<uint16_t>(count))};
+            if (m_random.chance(s.numbered)) {
+                for (uint32_t i {0}; i < count; ++i) m_writer.set_name(first + i, std::to_string(i));
+                if (m_random.chance(.5)) {
+                    uint32_t const kind {pick(s)};
+                    for (uint32_t i {0}; i < count; ++i) value(first + i, s, kind);
+                    return;
+                }
+            } else if (!level && m_random.chance(s.ids)) {
+                uint64_t id {m_random.between(1, 9) * 1000000ull};
+                for (uint32_t i {0}; i < count; ++i) {
+                    id += m_random.skewed(1, 100);
+                    m_writer.set_name(first + i, std::to_string(id));
+                }
+            } else {
+                std::vector<std::string> const names {unique_names(s, count, "")};
+                for (uint32_t i {0}; i < count; ++i) m_writer.set_name(first + i, names[i]);
+            }
+            for (uint32_t i {0}; i < count; ++i) fill(first + i, s, level + 1);
+        }
+        //Returns 0 for integers, 1 for reals, and so on in the order of the weights in shape
+        uint32_t pick(shape const & s) {
+            uint32_t const weights[] {s.integers, s.reals, s.strings, s.vectors, s.bitmaps, s.audio};
+            uint32_t total {0};
+            for (uint32_t w : weights) total += w;
+            if (!total) return 0;
+            uint32_t r {m_random.between(0, total - 1)};
+            for (uint32_t i {0};; ++i) {
+                if (r < weights[i]) return i;
+                r -= weights[i];
+            }
+        }
+        void value(nx_writer::node_id n, shape const & s, uint32_t kind) {
+            switch (kind) {
+            case 0:
+                m_writer.set_integer(n, m_random.chance(.1) ? -static_cast<int64_t>(m_random.skewed(0, 1000))
+                    : m_random.chance(.1) ? m_random.between(0, 0x7fffffff) : m_random.skewed(0, 1000));
+                break;
+            case 1:
+                m_writer.set_real(n, m_random.unit() * 100);
+                break;
+            case 2:
+                if (!m_strings.empty() && m_random.chance(s.repeats)) {
+                    m_writer.set_string(n, m_strings[m_random.between(0, static_cast<uint32_t>(m_strings.size() - 1))]);
+                } else {
+                    std::string str {};
+                    uint32_t const length {m_random.between(s.string_min, s.string_max)};
+                    while (str.size() < length) str += (str.empty() ? "" : " ") + word(1, 8);
+                    uint32_t const id {m_writer.add_string(str)};
+                    m_strings.push_back(id);
+                    m_writer.set_string(n, id);
+                }
+                break;
+            case 3:
+                m_writer.set_vector(n, static_cast<int32_t>(m_random.skewed(0, 1000)) - 500, static_cast<int32_t>(m_random.skewed(0, 1000)) - 500);
+                break;
+            case 4:
+                bitmap(n, s);
+                break;
+            case 5:
+                audio(n, s);
+                break;
+            }
+        }
+        //The first part of each row is flat like the transparent borders of sprites, the rest noise,
+        //with compressibility picking how much of each row is flat
+        void bitmap(nx_writer::node_id n, shape const & s) {
+            uint32_t const width {m_random.skewed(s.bitmap_min, s.bitmap_max)}, height {m_random.skewed(s.bitmap_min, s.bitmap_max)};
+            uint32_t const flat {static_cast<uint32_t>(width * m_compressibility)};
+            m_pixels.assign(width * height * 4, 0);
+            for (uint32_t y {0}; y < height; ++y) {
+                for (uint32_t x {flat}; x < width; ++x) {
+                    uint8_t * const p {&m_pixels[(y * width + x) * 4]};
+                    uint32_t const r {m_random.between(0, 0xffffffff)};
+                    p[0] = static_cast<uint8_t>(r);
+                    p[1] = static_cast<uint8_t>(r >> 8);
+                    p[2] = static_cast<uint8_t>(r >> 16);
+                    p[3] = 0xff;
+                }
+            }
+            m_compressed.resize(lz4::compress_bound(m_pixels.size()));
+            size_t const size {lz4::compress(m_pixels.data(), m_compressed.data(), m_pixels.size())};
+            uint32_t const id {m_writer.add_bitmap(m_compressed.data(), static_cast<uint32_t>(size),
+                static_cast<uint16_t>(width), static_cast<uint16_t>(height), bitmap::format::bgra8888, bitmap::codec::lz4)};
+            m_writer.set_bitmap(n, id, static_cast<uint16_t>(width), static_cast<uint16_t>(height));
+            if (!m_random.chance(s.canvas)) return;
+            nx_writer::node_id const first {m_writer.add_children(n, 2)};
+            m_writer.set_name(first, "origin");
+            m_writer.set_vector(first, static_cast<int32_t>(width / 2), static_cast<int32_t>(height));
+            m_writer.set_name(first + 1, "delay");
+            m_writer.set_integer(first + 1, 60 + m_random.skewed(0, 20) * 10);
+        }
+        void audio(nx_writer::node_id n, shape const & s) {
+            uint32_t const size {m_random.skewed(s.audio_min, s.audio_max)};
+            uint32_t const flat {static_cast<uint32_t>(size * m_compressibility)};
+            m_pixels.assign(size, 0);
+            for (uint32_t i {flat}; i < size; ++i) m_pixels[i] = static_cast<uint8_t>(m_random.between(0, 0xff));
+            m_writer.set_audio(n, m_writer.add_audio(m_pixels.data(), size), size);
+        }
+        generator(generator const &);//Todo: Replace with = delete once VS has support for it.
+        generator & operator=(generator const &);//Todo: Replace with = delete once VS has support for it.
+        nx_writer & m_writer;
+        random m_random;
+        double m_compressibility;
+        std::vector<uint32_t> m_strings;
+        std::vector<uint8_t> m_pixels;
+        std::vector<char> m_compressed;
+    };
+    std::pair<uint32_t, uint32_t> range(std::string const & s) {
+        size_t const dash {s.find('-')};
+        uint32_t const low {static_cast<uint32_t>(std::stoul(s.substr(0, dash)))};
+        uint32_t const high {dash == std::string::npos ? low : static_cast<uint32_t>(std::stoul(s.substr(dash + 1)))};
+        if (high < low) throw std::runtime_error {"Bad range " + s};
+        return {low, high};
+    }
+}
+int main(int argc, char ** argv) {
+    std::string preset {"map"}, filename {};
+    uint32_t seed {0};
+    double scale {1}, compressibility {.5};
+    nl::nx_writer::layout layout {nl::nx_writer::layout::depth_first};
+    bool front_code {false};
+    std::vector<std::pair<std::string, std::string>> overrides {};
+    try {
+        for (int i {1}; i < argc; ++i) {
+            std::string const arg {argv[i]};
+            //--preset <map|character|string|tiny> picks the shape of the file
+            if (arg == "--preset" && i + 1 < argc) preset = argv[++i];
+            else if (arg == "--seed" && i + 1 < argc) seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            //--scale <factor> multiplies the number of imgs
+            else if (arg == "--scale" && i + 1 < argc) scale = std::stod(argv[++i]);
+            //--compressibility <0-1> is how much of each bitmap and audio is flat instead of noise
+            else if (arg == "--compressibility" && i + 1 < argc) compressibility = std::min(std::max(std::stod(argv[++i]), 0.), 1.);
+            else if (arg == "--front-code") front_code = true;
+            else if (arg == "--layout" && i + 1 < argc) {
+                std::string const l {argv[++i]};
+                if (l == "dfs") layout = nl::nx_writer::layout::depth_first;
+                else if (l == "bfs") layout = nl::nx_writer::layout::breadth_first;
+                else if (l == "parse") layout = nl::nx_writer::layout::insertion;
+                else throw std::runtime_error {"Unknown layout " + l};
+            }
+            //--depth, --fanout, --names, --mix, --bitmaps and --imgs override every directory of the preset
+            else if ((arg == "--depth" || arg == "--fanout" || arg == "--names" || arg == "--mix"
+                || arg == "--bitmaps" || arg == "--imgs") && i + 1 < argc) overrides.emplace_back(arg, argv[++i]);
+            else if (arg[0] != '-' && filename.empty()) filename = arg;
+            else {
+                std::cerr << "Usage: " << argv[0] << " [options] <out.nx>\n"
+                    << "  --preset <map|character|string|tiny>  shape of the file, map by default\n"
+                    << "  --seed <n>                            the same seed always gives the same file\n"
+                    << "  --scale <factor>                      multiplies the number of imgs\n"
+                    << "  --depth <n>                           levels below each img\n"
+                    << "  --fanout <min-max>                    children of each node below the imgs\n"
+                    << "  --names <min-max>                     length of names\n"
+                    << "  --mix <int,real,string,vector,bitmap,audio>  relative weights of each type of value\n"
+                    << "  --bitmaps <min-max>                   width and height of bitmaps\n"
+                    << "  --imgs <n>                            imgs in each directory\n"
+                    << "  --compressibility <0-1>               how much of each bitmap and audio is flat, .5 by default\n"
+                    << "  --layout <dfs|bfs|parse>              order of the nodes, dfs by default\n"
+                    << "  --front-code                          store the strings front coded" << std::endl;
+                return 1;
+            }
+        }
+        if (filename.empty()) throw std::runtime_error {"No output file given"};
+        std::vector<nl::shape> shapes {nl::preset(preset)};
+        for (nl::shape & s : shapes) {
+            s.imgs = std::max<uint32_t>(static_cast<uint32_t>(s.imgs * scale + .5), 1);
+            for (auto const & o : overrides) {
+                if (o.first == "--depth") s.depth = static_cast<uint32_t>(std::stoul(o.second));
+                else if (o.first == "--imgs") s.imgs = static_cast<uint32_t>(std::stoul(o.second));
+                else if (o.first == "--fanout") std::tie(s.fanout_min, s.fanout_max) = nl::range(o.second);
+                else if (o.first == "--names") std::tie(s.name_min, s.name_max) = nl::range(o.second);
+                else if (o.first == "--bitmaps") std::tie(s.bitmap_min, s.bitmap_max) = nl::range(o.second);
+                else if (o.first == "--mix") {
+                    uint32_t * const weights[] {&s.integers, &s.reals, &s.strings, &s.vectors, &s.bitmaps, &s.audio};
+                    size_t b {0};
+                    for (uint32_t * w : weights) {
+                        size_t const e {o.second.find(',', b)};
+                        *w = b < o.second.size() ? static_cast<uint32_t>(std::stoul(o.second.substr(b, e - b))) : 0;
+                        b = e == std::string::npos ? o.second.size() : e + 1;
+                    }
+                }
+            }
+            if (!s.name_min) s.name_min = 1;
+            if (!s.bitmap_min) s.bitmap_min = 1;
+        }
+        nl::nx_writer writer {filename};
+        nl::generator gen {writer, seed, compressibility};
+        //A preset with a single unnamed directory puts its imgs straight in the root, like String.nx
+        if (shapes.size() == 1 && shapes[0].name.empty()) gen.directory(0, shapes[0], shapes[0].dir_depth);
+        else {
+            nl::nx_writer::node_id const first {writer.add_children(0, static_cast<uint16_t>(shapes.size()))};
+            for (size_t i {0}; i < shapes.size(); ++i) {
+                writer.set_name(first + static_cast<uint32_t>(i), shapes[i].name);
+                gen.directory(first + static_cast<uint32_t>(i), shapes[i], 0);
+            }
+        }
+        writer.pack_arrays();
+        writer.set_layout(layout);
+        if (front_code) writer.front_code_strings();
+        writer.finish();
+        std::cout << "Wrote " << writer.node_count() << " nodes, " << writer.string_count() << " strings, "
+            << writer.bitmap_count() << " bitmaps and " << writer.audio_count() << " audio to " << filename << std::endl;
+    } catch (std::exception const & e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
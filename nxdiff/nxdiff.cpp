@@ -0,0 +1,207 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNxDiff - Part of the NoLifeStory project                           //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#include "patch.hpp"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+namespace nl {
+    namespace patch {
+        tree old_tree {}, new_tree {};
+        //Old payloads by hash, to find the ones the new file still uses
+        std::unordered_multimap<uint64_t, uint32_t> old_bitmaps {};
+        std::unordered_multimap<uint64_t, uint32_t> old_audio {};
+        //Payloads that go in the patch, by their index in the new file's payloads
+        std::unordered_map<uint32_t, uint32_t> patch_bitmap_index {};
+        std::unordered_map<uint32_t, uint32_t> patch_audio_index {};
+        std::vector<uint32_t> patch_bitmaps {};
+        std::vector<uint32_t> patch_audio {};
+        std::vector<char> records {};
+        size_t same_count {0};
+        size_t node_count {0};
+        template <typename T> void put(T const & v) {
+            char const * const p {reinterpret_cast<char const *>(&v)};
+            records.insert(records.end(), p, p + sizeof(T));
+        }
+        void put_string(std::pair<char const *, size_t> const & s) {
+            put(static_cast<uint16_t>(s.second));
+            records.insert(records.end(), s.first, s.first + s.second);
+        }
+        //The hashes only pick the candidates, so a subtree is only reused once it compares equal node by node
+        bool same_subtree(node o, node n) {
+            std::pair<char const *, size_t> const on {o.name_fast()}, nn {n.name_fast()};
+            if (on.second != nn.second || std::memcmp(on.first, nn.first, nn.second)) return false;
+            if (o.data_type() != n.data_type() || o.size() != n.size()) return false;
+            switch (n.data_type()) {
+            case node::type::integer: if (o.get_integer() != n.get_integer()) return false; break;
+            case node::type::real: if (o.get_real() != n.get_real()) return false; break;
+            case node::type::string: if (o.get_string() != n.get_string()) return false; break;
+            case node::type::vector: if (o.x() != n.x() || o.y() != n.y()) return false; break;
+            case node::type::bitmap: {
+                bitmap const ob {o.get_bitmap()}, nb {n.get_bitmap()};
+                if (ob.pixel_format() != nb.pixel_format() || ob.payload_codec() != nb.payload_codec()) return false;
+                if (ob.width() != nb.width() || ob.height() != nb.height() || ob.payload_length() != nb.payload_length()) return false;
+                if (std::memcmp(ob.payload(), nb.payload(), nb.payload_length())) return false;
+                break;
+            }
+            case node::type::audio: {
+                audio const oa {o.get_audio()}, na {n.get_audio()};
+                if (oa.length() != na.length() || std::memcmp(oa.data(), na.data(), na.length())) return false;
+                break;
+            }
+            default: break;
+            }
+            node oc {o.begin()};
+            for (node nc : n) if (!same_subtree(oc++, nc)) return false;
+            return true;
+        }
+        void open(tree & t, std::string const & name) {
+            attach(t, *new file {name});
+        }
+        //Returns the index of an identical payload in the old file, or where it goes in the patch
+        std::pair<source, uint32_t> find_bitmap(bitmap b) {
+            uint32_t const i {new_tree.p.bitmap_index[b.id()]};
+            auto const range = old_bitmaps.equal_range(new_tree.p.bitmap_hashes[i]);
+            for (auto it = range.first; it != range.second; ++it) {
+                bitmap const & o {old_tree.p.bitmaps[it->second]};
+                if (o.pixel_format() != b.pixel_format() || o.payload_codec() != b.payload_codec()) continue;
+                if (o.payload_length() != b.payload_length() || std::memcmp(o.payload(), b.payload(), b.payload_length())) continue;
+                return {source::old, it->second};
+            }
+            auto const it = patch_bitmap_index.emplace(i, static_cast<uint32_t>(patch_bitmaps.size()));
+            if (it.second) patch_bitmaps.push_back(i);
+            return {source::patch, it.first->second};
+        }
+        std::pair<source, uint32_t> find_audio(audio a) {
+            uint32_t const i {new_tree.p.audio_index[a.id()]};
+            auto const range = old_audio.equal_range(new_tree.p.audio_hashes[i]);
+            for (auto it = range.first; it != range.second; ++it) {
+                audio const & o {old_tree.p.sounds[it->second]};
+                if (o.length() != a.length() || std::memcmp(o.data(), a.data(), a.length())) continue;
+                return {source::old, it->second};
+            }
+            auto const it = patch_audio_index.emplace(i, static_cast<uint32_t>(patch_audio.size()));
+            if (it.second) patch_audio.push_back(i);
+            return {source::patch, it.first->second};
+        }
+        //o is the node at the same path in the old file, or a null node if there is none
+        void emit(node o, node n) {
+            if (o && subtree_hash(old_tree, o) == subtree_hash(new_tree, n) && same_subtree(o, n)) {
+                put(op::same);
+                ++same_count;
+                return;
+            }
+            put(op::node);
+            ++node_count;
+            put(n.data_type());
+            switch (n.data_type()) {
+            case node::type::integer: put(n.get_integer()); break;
+            case node::type::real: put(n.get_real()); break;
+            case node::type::string: {
+                std::string const s {n.get_string()};
+                put_string({s.data(), s.size()});
+                break;
+            }
+            case node::type::vector: put(n.x()), put(n.y()); break;
+            case node::type::bitmap: {
+                bitmap const b {n.get_bitmap()};
+                std::pair<source, uint32_t> const p {find_bitmap(b)};
+                put(p.first), put(p.second), put(b.width()), put(b.height());
+                break;
+            }
+            case node::type::audio: {
+                audio const a {n.get_audio()};
+                std::pair<source, uint32_t> const p {find_audio(a)};
+                put(p.first), put(p.second), put(a.length());
+                break;
+            }
+            default: break;
+            }
+            put(static_cast<uint16_t>(n.size()));
+            for (node c : n) {
+                std::pair<char const *, size_t> const name {c.name_fast()};
+                put_string(name);
+                emit(o[name], c);
+            }
+        }
+        void nxdiff(std::string const & old_name, std::string const & new_name, std::string const & patch_name) {
+            open(old_tree, old_name);
+            open(new_tree, new_name);
+            std::thread other {[] { gather(*old_tree.f, old_tree.p); }};
+            gather(*new_tree.f, new_tree.p);
+            other.join();
+            std::cout << "Hashed payloads" << std::endl;
+            for (uint32_t i {0}; i < old_tree.p.bitmaps.size(); ++i) old_bitmaps.emplace(old_tree.p.bitmap_hashes[i], i);
+            for (uint32_t i {0}; i < old_tree.p.sounds.size(); ++i) old_audio.emplace(old_tree.p.audio_hashes[i], i);
+            emit(*old_tree.f, *new_tree.f);
+            std::cout << "Compared nodes" << std::endl;
+            std::ofstream out {patch_name, std::ios::binary};
+            if (!out) throw std::runtime_error {"Failed to open file " + patch_name};
+            header const h {magic, 0, identity(old_tree),
+                static_cast<uint32_t>(patch_bitmaps.size()), static_cast<uint32_t>(patch_audio.size())};
+            out.write(reinterpret_cast<char const *>(&h), sizeof(h));
+            uint64_t payload_bytes {0};
+            for (uint32_t i : patch_bitmaps) {
+                bitmap const & b {new_tree.p.bitmaps[i]};
+                uint8_t const info[4] {static_cast<uint8_t>(b.pixel_format()), static_cast<uint8_t>(b.payload_codec()), b.has_alpha_info(), 0};
+                bitmap_alpha const alpha {alpha_of(b)};
+                uint32_t const size {b.payload_length()};
+                out.write(reinterpret_cast<char const *>(info), sizeof(info));
+                out.write(reinterpret_cast<char const *>(&alpha), sizeof(alpha));
+                out.write(reinterpret_cast<char const *>(&size), sizeof(size));
+                out.write(reinterpret_cast<char const *>(b.payload()), size);
+                payload_bytes += size;
+            }
+            for (uint32_t i : patch_audio) {
+                audio const & a {new_tree.p.sounds[i]};
+                uint8_t const has_info {a.has_info()};
+                audio_info const info {info_of(a)};
+                uint32_t const size {a.length()};
+                out.write(reinterpret_cast<char const *>(&has_info), sizeof(has_info));
+                out.write(reinterpret_cast<char const *>(&info), sizeof(info));
+                out.write(reinterpret_cast<char const *>(&size), sizeof(size));
+                out.write(reinterpret_cast<char const *>(a.data()), size);
+                payload_bytes += size;
+            }
+            out.write(records.data(), static_cast<std::streamsize>(records.size()));
+            if (!out) throw std::runtime_error {"Failed to write to file " + patch_name};
+            std::cout << "Wrote " << node_count << " changed nodes, " << same_count << " unchanged subtrees, "
+                << patch_bitmaps.size() << " bitmaps and " << patch_audio.size() << " audio totalling "
+                << payload_bytes << " bytes" << std::endl;
+        }
+    }
+}
+int main(int argc, char ** argv) {
+    std::chrono::high_resolution_clock::time_point a {std::chrono::high_resolution_clock::now()};
+    if (argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " <old.nx> <new.nx> <patch>" << std::endl;
+        return 1;
+    }
+    try {
+        nl::patch::nxdiff(argv[1], argv[2], argv[3]);
+    } catch (std::exception const & e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::chrono::high_resolution_clock::time_point b {std::chrono::high_resolution_clock::now()};
+    std::cout << "Took " << std::chrono::duration_cast<std::chrono::milliseconds>(b - a).count() << " ms" << std::endl;
+}
@@ -0,0 +1,291 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNxPatch - Part of the NoLifeStory project                          //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#include "patch.hpp"
+#include <nx/writer.hpp>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+namespace nl {
+    namespace patch {
+        //A payload stored in the patch itself
+        struct patch_bitmap {
+            uint8_t const * info;
+            bitmap_alpha alpha;
+            uint32_t size;
+            char const * data;
+        };
+        struct patch_audio {
+            bool has_info;
+            audio_info info;
+            uint32_t size;
+            char const * data;
+        };
+        std::vector<char> contents {};
+        char const * pos {nullptr};
+        char const * end {nullptr};
+        tree old_tree {};
+        std::vector<patch_bitmap> patch_bitmaps {};
+        std::vector<uint64_t> patch_bitmap_hashes {};
+        std::vector<patch_audio> patch_sounds {};
+        std::vector<uint64_t> patch_audio_hashes {};
+        //Ids in the output of the payloads already added, by their index in the old file or the patch
+        std::unordered_map<uint32_t, uint32_t> old_bitmap_ids {}, patch_bitmap_ids {};
+        std::unordered_map<uint32_t, uint32_t> old_audio_ids {}, patch_audio_ids {};
+        //Unchanged subtrees can share their children in the old file, so they are only copied once
+        std::unordered_map<void const *, nx_writer::node_id> copied_children {};
+        std::vector<bitmap_alpha> bitmap_alphas {};
+        std::vector<audio_info> audio_infos {};
+        bool all_alpha {true};
+        bool all_audio_info {true};
+        void read(void * p, size_t size) {
+            if (static_cast<size_t>(end - pos) < size) throw std::runtime_error {"Patch is truncated"};
+            std::memcpy(p, pos, size);
+            pos += size;
+        }
+        template <typename T> T read() {
+            T v;
+            read(&v, sizeof(T));
+            return v;
+        }
+        char const * skip(size_t size) {
+            char const * const p {pos};
+            if (static_cast<size_t>(end - pos) < size) throw std::runtime_error {"Patch is truncated"};
+            pos += size;
+            return p;
+        }
+        uint32_t add_old_bitmap(nx_writer & writer, uint32_t index) {
+            if (index >= old_tree.p.bitmaps.size()) throw std::runtime_error {"Patch refers to a missing bitmap"};
+            auto const it = old_bitmap_ids.find(index);
+            if (it != old_bitmap_ids.end()) return it->second;
+            bitmap const & b {old_tree.p.bitmaps[index]};
+            uint32_t const count {writer.bitmap_count()};
+            uint32_t const id {writer.add_bitmap(b.payload(), b.payload_length(), b.width(), b.height(),
+                b.pixel_format(), b.payload_codec(), old_tree.p.bitmap_hashes[index])};
+            if (id == count) {
+                bitmap_alphas.push_back(alpha_of(b));
+                all_alpha = all_alpha && b.has_alpha_info();
+            }
+            old_bitmap_ids.emplace(index, id);
+            return id;
+        }
+        uint32_t add_patch_bitmap(nx_writer & writer, uint32_t index, uint16_t width, uint16_t height) {
+            if (index >= patch_bitmaps.size()) throw std::runtime_error {"Patch refers to a missing bitmap"};
+            auto const it = patch_bitmap_ids.find(index);
+            if (it != patch_bitmap_ids.end()) return it->second;
+            patch_bitmap const & b {patch_bitmaps[index]};
+            uint32_t const count {writer.bitmap_count()};
+            uint32_t const id {writer.add_bitmap(b.data, b.size, width, height, static_cast<bitmap::format>(b.info[0]),
+                static_cast<bitmap::codec>(b.info[1]), patch_bitmap_hashes[index])};
+            if (id == count) {
+                bitmap_alphas.push_back(b.alpha);
+                all_alpha = all_alpha && b.info[2];
+            }
+            patch_bitmap_ids.emplace(index, id);
+            return id;
+        }
+        uint32_t add_old_audio(nx_writer & writer, uint32_t index) {
+            if (index >= old_tree.p.sounds.size()) throw std::runtime_error {"Patch refers to a missing audio"};
+            auto const it = old_audio_ids.find(index);
+            if (it != old_audio_ids.end()) return it->second;
+            audio const & a {old_tree.p.sounds[index]};
+            uint32_t const count {writer.audio_count()};
+            uint32_t const id {writer.add_audio(a.data(), a.length(), old_tree.p.audio_hashes[index])};
+            if (id == count) {
+                audio_infos.push_back(info_of(a));
+                all_audio_info = all_audio_info && a.has_info();
+            }
+            old_audio_ids.emplace(index, id);
+            return id;
+        }
+        uint32_t add_patch_audio(nx_writer & writer, uint32_t index) {
+            if (index >= patch_sounds.size()) throw std::runtime_error {"Patch refers to a missing audio"};
+            auto const it = patch_audio_ids.find(index);
+            if (it != patch_audio_ids.end()) return it->second;
+            patch_audio const & a {patch_sounds[index]};
+            uint32_t const count {writer.audio_count()};
+            uint32_t const id {writer.add_audio(a.data, a.size, patch_audio_hashes[index])};
+            if (id == count) {
+                audio_infos.push_back(a.info);
+                all_audio_info = all_audio_info && a.has_info;
+            }
+            patch_audio_ids.emplace(index, id);
+            return id;
+        }
+        //Copies an unchanged subtree from the old file
+        void copy(nx_writer & writer, node n, nx_writer::node_id id) {
+            switch (n.data_type()) {
+            case node::type::integer: writer.set_integer(id, n.get_integer()); break;
+            case node::type::real: writer.set_real(id, n.get_real()); break;
+            case node::type::string: writer.set_string(id, n.get_string()); break;
+            case node::type::vector: writer.set_vector(id, n.x(), n.y()); break;
+            case node::type::bitmap: {
+                bitmap const b {n.get_bitmap()};
+                writer.set_bitmap(id, add_old_bitmap(writer, old_tree.p.bitmap_index[b.id()]), b.width(), b.height());
+                break;
+            }
+            case node::type::audio: {
+                audio const a {n.get_audio()};
+                writer.set_audio(id, add_old_audio(writer, old_tree.p.audio_index[a.id()]), a.length());
+                break;
+            }
+            default: break;
+            }
+            if (!n.size()) return;
+            auto const it = copied_children.find(n.begin().m_data);
+            if (it != copied_children.end()) {
+                writer.set_children(id, it->second, static_cast<uint16_t>(n.size()));
+                return;
+            }
+            nx_writer::node_id const first {writer.add_children(id, static_cast<uint16_t>(n.size()))};
+            copied_children.emplace(n.begin().m_data, first);
+            nx_writer::node_id c {first};
+            for (node child : n) {
+                std::pair<char const *, size_t> const name {child.name_fast()};
+                writer.set_name(c, writer.add_string(name.first, static_cast<uint16_t>(name.second)));
+                copy(writer, child, c++);
+            }
+        }
+        //o is the node at the same path in the old file
+        void apply(nx_writer & writer, node o, nx_writer::node_id id) {
+            op const what {read<op>()};
+            if (what == op::same) {
+                if (!o) throw std::runtime_error {"Patch refers to a missing node"};
+                copy(writer, o, id);
+                return;
+            }
+            if (what != op::node) throw std::runtime_error {"Patch is corrupt"};
+            switch (read<node::type>()) {
+            case node::type::none: break;
+            case node::type::integer: writer.set_integer(id, read<int64_t>()); break;
+            case node::type::real: writer.set_real(id, read<double>()); break;
+            case node::type::string: {
+                uint16_t const length {read<uint16_t>()};
+                writer.set_string(id, writer.add_string(skip(length), length));
+                break;
+            }
+            case node::type::vector: {
+                int32_t const x {read<int32_t>()};
+                writer.set_vector(id, x, read<int32_t>());
+                break;
+            }
+            case node::type::bitmap: {
+                source const from {read<source>()};
+                uint32_t const index {read<uint32_t>()};
+                uint16_t const width {read<uint16_t>()};
+                uint16_t const height {read<uint16_t>()};
+                writer.set_bitmap(id, from == source::old ? add_old_bitmap(writer, index)
+                    : add_patch_bitmap(writer, index, width, height), width, height);
+                break;
+            }
+            case node::type::audio: {
+                source const from {read<source>()};
+                uint32_t const index {read<uint32_t>()};
+                uint32_t const length {read<uint32_t>()};
+                writer.set_audio(id, from == source::old ? add_old_audio(writer, index)
+                    : add_patch_audio(writer, index), length);
+                break;
+            }
+            default: throw std::runtime_error {"Patch is corrupt"};
+            }
+            uint16_t const count {read<uint16_t>()};
+            if (!count) return;
+            nx_writer::node_id const first {writer.add_children(id, count)};
+            for (uint16_t i {0}; i < count; ++i) {
+                uint16_t const length {read<uint16_t>()};
+                char const * const name {skip(length)};
+                writer.set_name(first + i, writer.add_string(name, length));
+                apply(writer, o[std::make_pair(name, static_cast<size_t>(length))], first + i);
+            }
+        }
+        void nxpatch(std::string const & old_name, std::string const & patch_name, std::string const & new_name) {
+            std::ifstream in {patch_name, std::ios::binary};
+            if (!in) throw std::runtime_error {"Failed to open file " + patch_name};
+            contents.assign(std::istreambuf_iterator<char> {in}, std::istreambuf_iterator<char> {});
+            pos = contents.data();
+            end = pos + contents.size();
+            header const h {read<header>()};
+            if (h.magic != magic) throw std::runtime_error {patch_name + " is not a patch"};
+            file const old {old_name};
+            attach(old_tree, old);
+            gather(old, old_tree.p);
+            if (identity(old_tree) != h.base) throw std::runtime_error {"Patch does not apply to " + old_name};
+            std::cout << "Opened " << old_name << std::endl;
+            for (uint32_t i {0}; i < h.bitmap_count; ++i) {
+                patch_bitmap b {};
+                b.info = reinterpret_cast<uint8_t const *>(skip(4));
+                read(&b.alpha, sizeof(b.alpha));
+                b.size = read<uint32_t>();
+                b.data = skip(b.size);
+                patch_bitmaps.push_back(b);
+            }
+            for (uint32_t i {0}; i < h.audio_count; ++i) {
+                patch_audio a {};
+                a.has_info = read<uint8_t>() != 0;
+                read(&a.info, sizeof(a.info));
+                a.size = read<uint32_t>();
+                a.data = skip(a.size);
+                patch_sounds.push_back(a);
+            }
+            patch_bitmap_hashes.resize(patch_bitmaps.size());
+            patch_audio_hashes.resize(patch_sounds.size());
+            parallel_for(patch_bitmaps.size() + patch_sounds.size(), [](size_t i) {
+                if (i < patch_bitmaps.size()) {
+                    patch_bitmap_hashes[i] = nx_writer::payload_hash(patch_bitmaps[i].data, patch_bitmaps[i].size);
+                } else {
+                    patch_audio const & a {patch_sounds[i - patch_bitmaps.size()]};
+                    patch_audio_hashes[i - patch_bitmaps.size()] = nx_writer::payload_hash(a.data, a.size);
+                }
+            });
+            nx_writer writer {new_name};
+            //The patched file keeps the extension sections of the file it was patched from
+            if (old.front_coded_strings()) writer.front_code_strings();
+            writer.pack_arrays();
+            apply(writer, old, 0);
+            if (pos != end) throw std::runtime_error {"Patch is corrupt"};
+            if (all_alpha && !bitmap_alphas.empty()) {
+                writer.add_section(0x41544D42, static_cast<uint32_t>(bitmap_alphas.size()), bitmap_alphas.data(), bitmap_alphas.size() * sizeof(bitmap_alpha));
+            }
+            if (all_audio_info && !audio_infos.empty()) {
+                writer.add_section(0x4D445541, static_cast<uint32_t>(audio_infos.size()), audio_infos.data(), audio_infos.size() * sizeof(audio_info));
+            }
+            std::cout << "Applied " << patch_bitmaps.size() << " new bitmaps and " << patch_sounds.size() << " new audio" << std::endl;
+            writer.finish();
+            std::cout << "Wrote " << new_name << std::endl;
+        }
+    }
+}
+int main(int argc, char ** argv) {
+    std::chrono::high_resolution_clock::time_point a {std::chrono::high_resolution_clock::now()};
+    if (argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " <old.nx> <patch> <new.nx>" << std::endl;
+        return 1;
+    }
+    try {
+        nl::patch::nxpatch(argv[1], argv[2], argv[3]);
+    } catch (std::exception const & e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::chrono::high_resolution_clock::time_point b {std::chrono::high_resolution_clock::now()};
+    std::cout << "Took " << std::chrono::duration_cast<std::chrono::milliseconds>(b - a).count() << " ms" << std::endl;
+}
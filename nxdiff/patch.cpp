@@ -0,0 +1,121 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNxDiff - Part of the NoLifeStory project                           //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#include "patch.hpp"
+#include <nx/writer.hpp>
+#include <algorithm>
+#include <string>
+#include <thread>
+
+namespace nl {
+    namespace patch {
+        void collect(node n, payloads & p) {
+            if (n.data_type() == node::type::bitmap) {
+                bitmap const b {n.get_bitmap()};
+                if (p.bitmap_index.emplace(b.id(), static_cast<uint32_t>(p.bitmaps.size())).second) p.bitmaps.push_back(b);
+            } else if (n.data_type() == node::type::audio) {
+                audio const a {n.get_audio()};
+                if (p.audio_index.emplace(a.id(), static_cast<uint32_t>(p.sounds.size())).second) p.sounds.push_back(a);
+            }
+            for (node c : n) collect(c, p);
+        }
+        void parallel_for(size_t count, std::function<void(size_t)> const & f) {
+            size_t const n {std::max<size_t>(std::thread::hardware_concurrency(), 1)};
+            std::vector<std::thread> threads {};
+            for (size_t t {0}; t < n; ++t) threads.emplace_back([&f, t, n, count] {
+                for (size_t i {t}; i < count; i += n) f(i);
+            });
+            for (std::thread & t : threads) t.join();
+        }
+        void gather(node root, payloads & p) {
+            collect(root, p);
+            p.bitmap_hashes.resize(p.bitmaps.size());
+            p.audio_hashes.resize(p.sounds.size());
+            parallel_for(p.bitmaps.size() + p.sounds.size(), [&p](size_t i) {
+                if (i < p.bitmaps.size()) {
+                    bitmap const & b {p.bitmaps[i]};
+                    p.bitmap_hashes[i] = nx_writer::payload_hash(b.payload(), b.payload_length());
+                } else {
+                    audio const & a {p.sounds[i - p.bitmaps.size()]};
+                    p.audio_hashes[i - p.bitmaps.size()] = nx_writer::payload_hash(a.data(), a.length());
+                }
+            });
+        }
+        void attach(tree & t, file const & f) {
+            t.f = &f;
+            node const root {f};
+            t.root = root.m_data;
+            t.hashes.assign(f.node_count(), 0);
+        }
+        uint64_t mix(uint64_t hash, void const * data, size_t size) {
+            uint8_t const * p {reinterpret_cast<uint8_t const *>(data)};
+            for (size_t i {0}; i < size; ++i) {
+                hash ^= p[i];
+                hash *= 1099511628211ULL;
+            }
+            return hash;
+        }
+        template <typename T> uint64_t mix(uint64_t hash, T const & v) {
+            return mix(hash, &v, sizeof(T));
+        }
+        uint64_t subtree_hash(tree & t, node n) {
+            uint64_t & memo {t.hashes[static_cast<size_t>(n.m_data - t.root)]};
+            if (memo) return memo;
+            std::pair<char const *, size_t> const name {n.name_fast()};
+            uint64_t h {mix(14695981039346656037ULL, name.first, name.second)};
+            h = mix(h, n.data_type());
+            switch (n.data_type()) {
+            case node::type::integer: h = mix(h, n.get_integer()); break;
+            case node::type::real: h = mix(h, n.get_real()); break;
+            case node::type::string: {
+                std::string const s {n.get_string()};
+                h = mix(h, s.data(), s.size());
+                break;
+            }
+            case node::type::vector: h = mix(mix(h, n.x()), n.y()); break;
+            case node::type::bitmap: {
+                bitmap const b {n.get_bitmap()};
+                h = mix(h, t.p.bitmap_hashes[t.p.bitmap_index[b.id()]]);
+                h = mix(mix(mix(mix(h, b.pixel_format()), b.payload_codec()), b.width()), b.height());
+                break;
+            }
+            case node::type::audio: {
+                audio const a {n.get_audio()};
+                h = mix(mix(h, t.p.audio_hashes[t.p.audio_index[a.id()]]), a.length());
+                break;
+            }
+            default: break;
+            }
+            h = mix(h, static_cast<uint16_t>(n.size()));
+            for (node c : n) h = mix(h, subtree_hash(t, c));
+            return memo = h | 1;
+        }
+        uint64_t identity(tree & t) {
+            uint64_t const counts[4] {t.f->node_count(), t.f->string_count(), t.f->bitmap_count(), t.f->audio_count()};
+            return mix(nx_writer::payload_hash(counts, sizeof(counts)), subtree_hash(t, *t.f));
+        }
+        bitmap_alpha alpha_of(bitmap b) {
+            bitmap::rect const r {b.bounds()};
+            return {r.left, r.top, r.right, r.bottom, (b.opaque() ? 1u : 0u) | (b.partial_alpha() ? 2u : 0u)};
+        }
+        audio_info info_of(audio a) {
+            return {a.sample_rate(), a.duration(), a.channels(), a.bits_per_sample(),
+                static_cast<uint8_t>(a.payload_codec()), 0, static_cast<uint16_t>(a.length() - a.sound_length())};
+        }
+    }
+}
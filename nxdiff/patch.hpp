@@ -0,0 +1,101 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNxDiff - Part of the NoLifeStory project                           //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <nx/file.hpp>
+#include <nx/node.hpp>
+#include <nx/bitmap.hpp>
+#include <nx/audio.hpp>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+//Shared by NoLifeNxDiff and NoLifeNxPatch
+//A patch starts with a header, followed by the bitmap and audio payloads the old file doesn't have,
+//followed by the node tree in depth first order
+//Each node record is either same, meaning the subtree is identical to the node at that path in the old file,
+//or a full node with its data and its children, each child being preceded by its name
+namespace nl {
+    namespace patch {
+        uint32_t const magic {0x3150584E};//NXP1
+        enum class op : uint8_t {
+            same = 0,
+            node = 1,
+        };
+        //Where the payload of a bitmap or audio node comes from
+        enum class source : uint8_t {
+            old = 0,
+            patch = 1,
+        };
+#pragma pack(push, 1)
+        struct header {
+            uint32_t magic;
+            uint32_t reserved;
+            uint64_t base;
+            uint32_t bitmap_count;
+            uint32_t audio_count;
+        };
+        //Same layout as the metadata sections WzToNx writes
+        struct bitmap_alpha {
+            uint16_t left, top, right, bottom;
+            uint32_t flags;
+        };
+        struct audio_info {
+            uint32_t sample_rate;
+            uint32_t duration;
+            uint16_t channels;
+            uint16_t bits_per_sample;
+            uint8_t codec;
+            uint8_t reserved;
+            uint16_t header_length;
+        };
+#pragma pack(pop)
+        //Every distinct bitmap and audio in a file, in the order a depth first walk finds them
+        //along with the nx_writer::payload_hash of each one
+        struct payloads {
+            std::vector<bitmap> bitmaps;
+            std::vector<uint64_t> bitmap_hashes;
+            std::unordered_map<size_t, uint32_t> bitmap_index;
+            std::vector<audio> sounds;
+            std::vector<uint64_t> audio_hashes;
+            std::unordered_map<size_t, uint32_t> audio_index;
+        };
+        struct tree {
+            file const * f;
+            node_data const * root;
+            payloads p;
+            //Subtree hashes by node index, 0 until computed
+            std::vector<uint64_t> hashes;
+        };
+        //Calls f for every index below count, spread over every core
+        void parallel_for(size_t count, std::function<void(size_t)> const & f);
+        //The hashing is spread over every core
+        void gather(node root, payloads &);
+        //Points the tree at a file, gather still has to fill in its payloads
+        void attach(tree &, file const &);
+        //Covers the name, the data with payloads standing in as their hashes, and every descendant
+        //The payloads of the tree must have been gathered
+        uint64_t subtree_hash(tree &, node);
+        //Identifies the file a patch applies to by its counts and the hash of its whole tree
+        uint64_t identity(tree &);
+        bitmap_alpha alpha_of(bitmap);
+        audio_info info_of(audio);
+    }
+}
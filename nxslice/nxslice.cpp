@@ -0,0 +1,228 @@
+//////////////////////////////////////////////////////////////////////////////
+// NoLifeNxSlice - Part of the NoLifeStory project                          //
+// Copyright © 2013 Peter Atashian                                          //
+//                                                                          //
+// This program is free software: you can redistribute it and/or modify     //
+// it under the terms of the GNU Affero General Public License as           //
+// published by the Free Software Foundation, either version 3 of the       //
+// License, or (at your option) any later version.                          //
+//                                                                          //
+// This program is distributed in the hope that it will be useful,          //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of           //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            //
+// GNU Affero General Public License for more details.                      //
+//                                                                          //
+// You should have received a copy of the GNU Affero General Public License //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.    //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <nx/file.hpp>
+#include <nx/node.hpp>
+#include <nx/bitmap.hpp>
+#include <nx/audio.hpp>
+#include <nx/writer.hpp>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nl {
+    //The extension sections are copied over entry by entry with the indices remapped
+#pragma pack(push, 1)
+    struct bitmap_alpha {
+        uint16_t left, top, right, bottom;
+        uint32_t flags;
+    };
+    struct audio_info {
+        uint32_t sample_rate;
+        uint32_t duration;
+        uint16_t channels;
+        uint16_t bits_per_sample;
+        uint8_t codec;
+        uint8_t reserved;
+        uint16_t header_length;
+    };
+#pragma pack(pop)
+    bool keep_bitmaps {true};
+    bool keep_audio {true};
+    //Each pattern split into its path segments
+    std::vector<std::vector<std::string>> patterns {};
+    //Payloads already copied, by the id of the original
+    std::unordered_map<size_t, uint32_t> bitmap_ids {};
+    std::unordered_map<size_t, uint32_t> audio_ids {};
+    //Nodes can share their children, which WzToNx does for resolved UOLs, so whole subtrees are only copied once
+    std::unordered_map<void const *, nx_writer::node_id> copied_children {};
+    std::vector<bitmap_alpha> bitmap_alphas {};
+    std::vector<audio_info> audio_infos {};
+    bool all_alpha {true};
+    bool all_audio_info {true};
+    //Segments may use * to match any run of characters and ? to match any single character
+    bool glob(std::string const & p, std::pair<char const *, size_t> const & name) {
+        char const * const s {name.first};
+        size_t const n {name.second};
+        size_t pi {0}, si {0}, star {std::string::npos}, mark {0};
+        while (si < n) {
+            if (pi < p.size() && (p[pi] == '?' || p[pi] == s[si])) ++pi, ++si;
+            else if (pi < p.size() && p[pi] == '*') star = pi++, mark = si;
+            else if (star != std::string::npos) pi = star + 1, si = ++mark;
+            else return false;
+        }
+        while (pi < p.size() && p[pi] == '*') ++pi;
+        return pi == p.size();
+    }
+    //Returns true if one of the patterns ends at this node, so the whole subtree is wanted
+    //Otherwise fills next with the patterns that may still match something below it
+    bool match(node n, std::vector<size_t> const & alive, size_t depth, std::vector<size_t> & next) {
+        std::pair<char const *, size_t> const name {n.name_fast()};
+        for (size_t p : alive) if (glob(patterns[p][depth], name)) {
+            if (patterns[p].size() == depth + 1) return true;
+            next.push_back(p);
+        }
+        return false;
+    }
+    //Whether anything below the node matches, so that paths leading nowhere are left out
+    bool selected(node n, std::vector<size_t> const & alive, size_t depth) {
+        for (node c : n) {
+            std::vector<size_t> next {};
+            if (match(c, alive, depth, next)) return true;
+            if (!next.empty() && selected(c, next, depth + 1)) return true;
+        }
+        return false;
+    }
+    uint32_t add_bitmap(nx_writer & writer, bitmap b) {
+        auto const it = bitmap_ids.find(b.id());
+        if (it != bitmap_ids.end()) return it->second;
+        uint32_t const count {writer.bitmap_count()};
+        uint32_t const index {writer.add_bitmap(b.payload(), b.payload_length(), b.width(), b.height(), b.pixel_format(), b.payload_codec())};
+        if (index == count) {
+            bitmap::rect const r {b.bounds()};
+            bitmap_alphas.push_back({r.left, r.top, r.right, r.bottom, (b.opaque() ? 1u : 0u) | (b.partial_alpha() ? 2u : 0u)});
+            all_alpha = all_alpha && b.has_alpha_info();
+        }
+        bitmap_ids.emplace(b.id(), index);
+        return index;
+    }
+    uint32_t add_audio(nx_writer & writer, audio a) {
+        auto const it = audio_ids.find(a.id());
+        if (it != audio_ids.end()) return it->second;
+        uint32_t const count {writer.audio_count()};
+        uint32_t const index {writer.add_audio(a.data(), a.length())};
+        if (index == count) {
+            audio_infos.push_back({a.sample_rate(), a.duration(), a.channels(), a.bits_per_sample(),
+                static_cast<uint8_t>(a.payload_codec()), 0, static_cast<uint16_t>(a.length() - a.sound_length())});
+            all_audio_info = all_audio_info && a.has_info();
+        }
+        audio_ids.emplace(a.id(), index);
+        return index;
+    }
+    //Stripped bitmaps and audio leave their nodes behind without any data, as their children are often still useful
+    void copy_data(nx_writer & writer, node n, nx_writer::node_id id) {
+        switch (n.data_type()) {
+        case node::type::integer: writer.set_integer(id, n.get_integer()); break;
+        case node::type::real: writer.set_real(id, n.get_real()); break;
+        case node::type::string: writer.set_string(id, n.get_string()); break;
+        case node::type::vector: writer.set_vector(id, n.x(), n.y()); break;
+        case node::type::bitmap:
+            if (keep_bitmaps) {
+                bitmap const b {n.get_bitmap()};
+                writer.set_bitmap(id, add_bitmap(writer, b), b.width(), b.height());
+            }
+            break;
+        case node::type::audio:
+            if (keep_audio) {
+                audio const a {n.get_audio()};
+                writer.set_audio(id, add_audio(writer, a), a.length());
+            }
+            break;
+        default: break;
+        }
+    }
+    //Children have to be contiguous, so figure out which ones survive before adding any of them
+    void copy(nx_writer & writer, node n, nx_writer::node_id id, std::vector<size_t> const & alive, size_t depth, bool whole) {
+        struct child {
+            node n;
+            bool whole;
+            std::vector<size_t> alive;
+        };
+        copy_data(writer, n, id);
+        if (whole && n.size()) {
+            auto const it = copied_children.find(n.begin().m_data);
+            if (it != copied_children.end()) {
+                writer.set_children(id, it->second, static_cast<uint16_t>(n.size()));
+                return;
+            }
+        }
+        std::vector<child> kept {};
+        for (node c : n) {
+            std::vector<size_t> next {};
+            if (whole || match(c, alive, depth, next)) kept.push_back({c, true, {}});
+            else if (!next.empty() && selected(c, next, depth + 1)) kept.push_back({c, false, next});
+        }
+        if (kept.empty()) return;
+        nx_writer::node_id const first {writer.add_children(id, static_cast<uint16_t>(kept.size()))};
+        if (whole) copied_children.emplace(n.begin().m_data, first);
+        for (size_t i {0}; i < kept.size(); ++i) {
+            std::pair<char const *, size_t> const name {kept[i].n.name_fast()};
+            writer.set_name(first + static_cast<nx_writer::node_id>(i), writer.add_string(name.first, static_cast<uint16_t>(name.second)));
+            copy(writer, kept[i].n, first + static_cast<nx_writer::node_id>(i), kept[i].alive, depth + 1, kept[i].whole);
+        }
+    }
+    void nxslice(std::string const & input, std::string const & output) {
+        file const in {input};
+        std::cout << "Opened " << input << std::endl;
+        nx_writer writer {output};
+        //The slice keeps the extension sections of the file it came from
+        if (in.front_coded_strings()) writer.front_code_strings();
+        writer.pack_arrays();
+        std::vector<size_t> alive {};
+        for (size_t i {0}; i < patterns.size(); ++i) alive.push_back(i);
+        copy(writer, in, 0, alive, 0, patterns.empty());
+        if (all_alpha && !bitmap_alphas.empty()) {
+            writer.add_section(0x41544D42, static_cast<uint32_t>(bitmap_alphas.size()), bitmap_alphas.data(), bitmap_alphas.size() * sizeof(bitmap_alpha));
+        }
+        if (all_audio_info && !audio_infos.empty()) {
+            writer.add_section(0x4D445541, static_cast<uint32_t>(audio_infos.size()), audio_infos.data(), audio_infos.size() * sizeof(audio_info));
+        }
+        std::cout << "Kept " << writer.node_count() << " of " << in.node_count() << " nodes, "
+            << writer.string_count() << " of " << in.string_count() << " strings, "
+            << writer.bitmap_count() << " of " << in.bitmap_count() << " bitmaps and "
+            << writer.audio_count() << " of " << in.audio_count() << " audio" << std::endl;
+        writer.finish();
+        std::cout << "Wrote " << output << std::endl;
+    }
+}
+int main(int argc, char ** argv) {
+    std::chrono::high_resolution_clock::time_point a {std::chrono::high_resolution_clock::now()};
+    std::vector<std::string> files {};
+    for (int i {1}; i < argc; ++i) {
+        std::string const arg {argv[i]};
+        //Strip options leave the nodes in place but drop their data and the payloads
+        if (arg == "--no-bitmaps") nl::keep_bitmaps = false;
+        else if (arg == "--no-audio") nl::keep_audio = false;
+        else if (files.size() < 2) files.push_back(arg);
+        //Every other argument is a pattern like Map/Map/Map1/* to keep, along with everything below it
+        else {
+            std::vector<std::string> segments {};
+            for (size_t b {0}, e {0}; e != std::string::npos; b = e + 1) {
+                e = arg.find('/', b);
+                std::string const s {arg.substr(b, e == std::string::npos ? std::string::npos : e - b)};
+                if (!s.empty()) segments.push_back(s);
+            }
+            if (!segments.empty()) nl::patterns.push_back(segments);
+        }
+    }
+    if (files.size() < 2) {
+        std::cerr << "Usage: " << argv[0] << " [--no-bitmaps] [--no-audio] <input.nx> <output.nx> [pattern...]" << std::endl;
+        return 1;
+    }
+    try {
+        nl::nxslice(files[0], files[1]);
+    } catch (std::exception const & e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::chrono::high_resolution_clock::time_point b {std::chrono::high_resolution_clock::now()};
+    std::cout << "Took " << std::chrono::duration_cast<std::chrono::milliseconds>(b - a).count() << " ms" << std::endl;
+}
@@ -3,40 +3,173 @@
 // Licensed under GPLv3          //
 ///////////////////////////////////
 
+//Runs the same workload against the WZ files with WZ::Node and the converted nx file with nl::node
+//Usage: wztest [WZ directory] [nx file] [path to look up]
+//Pass - instead of either file to leave that library out
 #include "../wz/wz.h"
+#include <nx/file.hpp>
+#include <nx/node.hpp>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
-#include <set>
+#include <string>
+#include <vector>
+#ifdef _WIN32
 #include <Windows.h>
 #include <Psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
 using namespace std;
-using namespace WZ;
 
-void recurse(Node n) {
-    for (Node nn : n) recurse(nn);
+struct Result {
+    bool ran;
+    double load;
+    double lookup;
+    double parse;
+    double recurse;
+    double nodes;
+    double found;
+    double memory;
+};
+double Now() {
+    return chrono::duration<double, micro>(chrono::high_resolution_clock::now().time_since_epoch()).count();
 }
-int main() {
-    LARGE_INTEGER freq, last, now;
-    QueryPerformanceFrequency(&freq);
-    QueryPerformanceCounter(&last);
-    AddPath("");
-    Init();
-    QueryPerformanceCounter(&now);
-    cout << "Load: " << 1000000*(now.QuadPart-last.QuadPart)/freq.QuadPart << " microseconds" << endl;
-    QueryPerformanceCounter(&last);
-    for (int n = 0; n < 1000000; ++n) {
-        Node nn = Base["Effect"]["BasicEff.img"]["LevelUp"]["5"]["origin"];
-    }
-    QueryPerformanceCounter(&now);
-    cout << "Access: " << 1000*(now.QuadPart-last.QuadPart)/freq.QuadPart << " milliseconds" << endl;
-    QueryPerformanceCounter(&last);
-    recurse(Base);
-    QueryPerformanceCounter(&now);
-    cout << "Recursive Parse: " << 1000*(now.QuadPart-last.QuadPart)/freq.QuadPart << " milliseconds" << endl;
-    QueryPerformanceCounter(&last);
-    recurse(Base);
-    QueryPerformanceCounter(&now);
-    cout << "Recurse: " << 1000*(now.QuadPart-last.QuadPart)/freq.QuadPart << " milliseconds" << endl;
+//Resident memory of the whole process in kilobytes
+//Without /proc only the peak is available, in which case only the first library to run gets a meaningful figure
+double Memory() {
+#ifdef _WIN32
     PROCESS_MEMORY_COUNTERS proc;
     GetProcessMemoryInfo(GetCurrentProcess(), &proc, sizeof(proc));
-    cout << "Memory usage: " << proc.PeakPagefileUsage/1000 << " kilobytes" << endl;
-}
\ No newline at end of file
+    return static_cast<double>(proc.WorkingSetSize / 1024);
+#else
+    if (FILE * f = fopen("/proc/self/statm", "r")) {
+        long size = 0, resident = 0;
+        int const read = fscanf(f, "%ld %ld", &size, &resident);
+        fclose(f);
+        if (read == 2) return static_cast<double>(resident * (sysconf(_SC_PAGESIZE) / 1024));
+    }
+    rusage u;
+    getrusage(RUSAGE_SELF, &u);
+#ifdef __APPLE__
+    return static_cast<double>(u.ru_maxrss / 1024);
+#else
+    return static_cast<double>(u.ru_maxrss);
+#endif
+#endif
+}
+size_t Recurse(WZ::Node n) {
+    size_t c = 1;
+    for (WZ::Node nn : n) c += Recurse(nn);
+    return c;
+}
+size_t Recurse(nl::node n) {
+    size_t c = 1;
+    for (nl::node nn : n) c += Recurse(nn);
+    return c;
+}
+//Both libraries get the same lookups, timed per lookup of the whole path
+const int Lookups = 1000000;
+//Each library reports how much its own work grew the process by, measured while its data is still loaded
+Result BenchWZ(string dir, vector<string> const & path) {
+    Result r = {true};
+    double const memory = Memory();
+    double last = Now();
+    WZ::AddPath(dir);
+    WZ::Init();
+    r.load = Now() - last;
+    last = Now();
+    //Counting the lookups that found something keeps the optimizer from throwing them away
+    size_t found = 0;
+    for (int i = 0; i < Lookups; ++i) {
+        WZ::Node n = WZ::Base;
+        for (string const & s : path) n = n[s];
+        if (n) ++found;
+    }
+    r.found = static_cast<double>(found);
+    r.lookup = (Now() - last) * 1000 / Lookups;
+    //WZ parses each img the first time it is accessed, so the first traversal includes the parsing
+    last = Now();
+    r.nodes = static_cast<double>(Recurse(WZ::Base));
+    r.parse = Now() - last;
+    last = Now();
+    Recurse(WZ::Base);
+    r.recurse = Now() - last;
+    r.memory = Memory() - memory;
+    return r;
+}
+Result BenchNX(string name, vector<string> const & path) {
+    Result r = {true};
+    double const memory = Memory();
+    double last = Now();
+    nl::file file(name);
+    r.load = Now() - last;
+    last = Now();
+    size_t found = 0;
+    for (int i = 0; i < Lookups; ++i) {
+        nl::node n = file;
+        for (string const & s : path) n = n[s];
+        if (n) ++found;
+    }
+    r.found = static_cast<double>(found);
+    r.lookup = (Now() - last) * 1000 / Lookups;
+    //Nothing needs parsing, so the first traversal only pays for reading the file from disk
+    last = Now();
+    r.nodes = static_cast<double>(Recurse(file.root()));
+    r.parse = Now() - last;
+    last = Now();
+    Recurse(file.root());
+    r.recurse = Now() - last;
+    r.memory = Memory() - memory;
+    return r;
+}
+int main(int argc, char ** argv) {
+    string dir = argc > 1 ? argv[1] : "";
+    string nx = argc > 2 ? argv[2] : "Data.nx";
+    string lookup = argc > 3 ? argv[3] : "Effect/BasicEff.img/LevelUp/5/origin";
+    vector<string> path;
+    for (size_t b = 0, e = 0; e != string::npos; b = e + 1) {
+        e = lookup.find('/', b);
+        path.push_back(lookup.substr(b, e == string::npos ? string::npos : e - b));
+    }
+    //The WZ library drops the .img from the names of imgs, while NX keeps it
+    vector<string> wzpath = path;
+    for (string & s : wzpath) {
+        if (s.size() > 4 && s.compare(s.size() - 4, 4, ".img") == 0) s.erase(s.size() - 4);
+    }
+    //NX goes first since it unmaps its file when done, leaving nothing behind in the resident memory WZ starts from
+    Result n = {false}, w = {false};
+    try {
+        if (nx != "-") n = BenchNX(nx, path);
+        if (dir != "-") w = BenchWZ(dir, wzpath);
+    } catch (exception const & e) {
+        cerr << e.what() << endl;
+        return 1;
+    } catch (...) {
+        //The WZ library throws plain ints when it fails
+        cerr << "Failed to load the WZ files" << endl;
+        return 1;
+    }
+    auto row = [&](char const * name, double Result::* field, char const * format) {
+        printf("%-24s", name);
+        for (Result const * r : {&w, &n}) {
+            if (r->ran) printf(format, r->*field);
+            else printf("%14s", "-");
+        }
+        printf("\n");
+    };
+    printf("%-24s%14s%14s\n", "", "WZ", "NX");
+    row("Load (us)", &Result::load, "%14.0f");
+    row("Lookup (ns)", &Result::lookup, "%14.1f");
+    row("First traversal (us)", &Result::parse, "%14.0f");
+    row("Traversal (us)", &Result::recurse, "%14.0f");
+    row("Lookups found", &Result::found, "%14.0f");
+    row("Nodes", &Result::nodes, "%14.0f");
+    row("Memory growth (KB)", &Result::memory, "%14.0f");
+    //Lookup times are only comparable when both libraries found the same thing
+    if (w.ran && n.ran && w.found != n.found) {
+        cerr << "The lookup of " << lookup << " found different results in WZ and NX" << endl;
+        return 1;
+    }
+}
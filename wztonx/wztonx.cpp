@@ -29,15 +29,35 @@
 #  include <unistd.h>
 #endif
 
+#include <nx/writer.hpp>
+#include <nx/lz4.hpp>
+#include <nx/bcn.hpp>
+#include <zlib.h>
+#ifdef NX_ZSTD
+#  include <zstd.h>
+#endif
+#ifdef WZTONX_MPG123
+#  include <mpg123.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86_FP) && _M_IX86_FP >= 2
+#  define WZTONX_SSE2
+#  include <emmintrin.h>
+#endif
 #include <iostream>
 #include <fstream>
-#include <codecvt>
+#include <cstring>
 #include <vector>
 #include <map>
 #include <cstdint>
-#include <unordered_map>
 #include <algorithm>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <random>
+#include <limits>
+#include <iomanip>
 
 namespace nl {
     typedef uint16_t strsize_t;
@@ -45,13 +65,7 @@ namespace nl {
     typedef uint32_t id_t;
     typedef uint32_t hash_t;
     typedef uint8_t key_t;
-
-    //Utility
-    template <typename T> struct identity {
-        T operator()(T const & v) const {
-            return v;
-        }
-    };
+    typedef key_t const key_table[65536];
 
     //File stuff
     namespace in {
@@ -101,90 +115,29 @@ namespace nl {
         void skip(size_t n) {
             offset += n;
         }
-        template <typename T> T read() {
-            T v {*reinterpret_cast<T const *>(offset)};
-            offset += sizeof(T);
+        //Every reader takes the position to read at, so each thread parsing imgs can have its own
+        template <typename T> T read(char const *& o) {
+            T v {*reinterpret_cast<T const *>(o)};
+            o += sizeof(T);
             return v;
         }
-        int32_t read_cint() {
-            int8_t a {read<int8_t>()};
-            return a != -128 ? a : read<int32_t>();
-        }
-    }
-    namespace out {
-        char * base {};
-        char * offset {};
-#ifdef _WIN32
-        void * file_handle {};
-        void * map_handle {};
-        void open(std::string p, size_t size) {
-            file_handle = CreateFileA(p.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, 0, nullptr);
-            if (file_handle == INVALID_HANDLE_VALUE) throw std::runtime_error {"Failed to open file " + p};
-            map_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READWRITE, size >> 32, size & 0xffffffff, nullptr);
-            if (map_handle == nullptr) throw std::runtime_error {"Failed to create file mapping of file " + p};
-            base = reinterpret_cast<char *>(MapViewOfFile(map_handle, FILE_MAP_ALL_ACCESS, 0, 0, 0));
-            if (base == nullptr) throw std::runtime_error {"Failed to map view of file " + p};
-            offset = base;
-        }
-        void close() {
-            UnmapViewOfFile(base);
-            CloseHandle(map_handle);
-            CloseHandle(file_handle);
-        }
-#else
-        int file_handle;
-        size_t file_size;
-        void open(std::string p, uint64_t size) {
-            file_handle = ::open(p.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-            if (file_handle == -1) throw std::runtime_error {"Failed to open file " + p};
-            file_size = size;
-            if (lseek(file_handle, file_size-1, SEEK_SET) == -1) throw std::runtime_error {"Error calling lseek() to 'stretch' file " + p};
-            if (write(file_handle, "", 1) != 1) throw std::runtime_error {"Error writing last byte of file " + p};
-            base = reinterpret_cast<char *>(mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file_handle, 0));
-            if (reinterpret_cast<intptr_t>(base) == -1) throw std::runtime_error {"Failed to create memory mapping of file " + p};
-            offset = base;
-        }
-        void close() {
-            munmap(const_cast<char *>(base), file_size);
-            ::close(file_handle);
-        }
-#endif
-        size_t tell() {
-            return static_cast<size_t>(offset - base);
-        }
-        void seek(size_t n) {
-            offset = base + n;
-        }
-        void skip(size_t n) {
-            offset += n;
+        int32_t read_cint(char const *& o) {
+            int8_t a {read<int8_t>(o)};
+            return a != -128 ? a : read<int32_t>(o);
         }
-        template <typename T> void write(T const & v) {
-            *reinterpret_cast<T *>(offset) = v;
-            offset += sizeof(T);
+        template <typename T> T read() {
+            return read<T>(offset);
         }
-        void write(void * buf, size_t size) {
-            memcpy(offset, buf, size);
-            offset += size;
+        int32_t read_cint() {
+            return read_cint(offset);
         }
     }
-
     //Memory allocation
     namespace alloc {
-        char * buffer {nullptr};
-        size_t remain {0};
         size_t const default_size {0x1000000};
         char * big(size_t size) {
             return new char[size];
         }
-        void * small(size_t size) {
-            if (size > remain) {
-                buffer = big(default_size);
-                remain = default_size;
-            }
-            char * r {buffer};
-            buffer += size, remain -= size;
-            return r;
-        }
     }
     //Node stuff
 #pragma pack(push, 1)
@@ -233,97 +186,296 @@ namespace nl {
         o.write(s.data, s.size);
         return o;
     }
-    std::unordered_map<hash_t, id_t, identity<hash_t>> string_map {};
-    std::vector<string> strings {};
+    //Hands out ids to strings in the order they are first added, keeping their bytes in big arena chunks
+    //An open addressing table holds the hash and id of each string, and the bytes are compared on a hash match
+    class string_table {
+    public:
+        string_table() : m_slots(0x400, slot {0, empty}), m_buffer {alloc::big(alloc::default_size)}, m_remain {alloc::default_size} {}
+        id_t add(char8_t const * data, strsize_t size) {
+            hash_t hash {2166136261UL};
+            char8_t const * s {data};
+            for (strsize_t i {size}; i; --i, ++s) {
+                hash ^= static_cast<hash_t>(*s);
+                hash *= 16777619UL;
+            }
+            size_t const mask {m_slots.size() - 1};
+            size_t i {hash & mask};
+            for (; m_slots[i].id != empty; i = (i + 1) & mask) {
+                if (m_slots[i].hash != hash) continue;
+                string const & st {m_strings[m_slots[i].id]};
+                if (st.size == size && !memcmp(st.data, data, size)) return m_slots[i].id;
+            }
+            id_t const id {static_cast<id_t>(m_strings.size())};
+            if (size > m_remain) {
+                m_buffer = alloc::big(alloc::default_size);
+                m_remain = alloc::default_size;
+            }
+            memcpy(m_buffer, data, size);
+            m_strings.push_back({m_buffer, size});
+            m_buffer += size, m_remain -= size;
+            m_slots[i] = slot {hash, id};
+            //Kept at most half full so probes stay short
+            if (m_strings.size() * 2 > m_slots.size()) grow();
+            return id;
+        }
+        string const & operator[](id_t id) const {
+            return m_strings[id];
+        }
+        size_t size() const {
+            return m_strings.size();
+        }
+        std::vector<string>::const_iterator begin() const {
+            return m_strings.begin();
+        }
+        std::vector<string>::const_iterator end() const {
+            return m_strings.end();
+        }
+    private:
+        string_table(string_table const &);//Todo: Replace with = delete once VS has support for it.
+        string_table & operator=(string_table const &);//Todo: Replace with = delete once VS has support for it.
+        struct slot {
+            hash_t hash;
+            id_t id;
+        };
+        static id_t const empty {0xFFFFFFFF};
+        //Rehashing only needs the stored hashes, never the bytes
+        void grow() {
+            std::vector<slot> slots(m_slots.size() * 2, slot {0, empty});
+            size_t const mask {slots.size() - 1};
+            for (auto const & s : m_slots) if (s.id != empty) {
+                size_t i {s.hash & mask};
+                while (slots[i].id != empty) i = (i + 1) & mask;
+                slots[i] = s;
+            }
+            m_slots.swap(slots);
+        }
+        std::vector<slot> m_slots;
+        std::vector<string> m_strings;
+        char8_t * m_buffer;
+        size_t m_remain;
+    };
+    string_table strings {};
     char16_t wstr_buf[0x8000] {};
-    char8_t str_buf[0x10000] {};
-    std::codecvt_utf8<char16_t> convert {};
+    char8_t str_buf[0x18000] {};
     extern key_t key_bms[65536];
     extern key_t key_gms[65536];
     extern key_t key_kms[65536];
-    key_t const (*const keys[3])[65536] {&key_bms, &key_gms, &key_kms};
-    key_t const (*cur_key)[65536] {nullptr};
+    key_table * const keys[3] {&key_bms, &key_gms, &key_kms};
+    key_table * cur_key {nullptr};
+    //Each key with the incrementing masks of the string encryption already applied, so decrypting a string is a single XOR
+    //narrow is for strings of bytes, with a mask starting at 0xAA, and wide for UTF-16 strings, with one starting at 0xAAAA
+    struct string_key {
+        uint8_t narrow[0x10000];
+        uint8_t wide[0x10000];
+    };
+    string_key string_keys[3] {};
+    string_key const * cur_string_key {nullptr};
     std::vector<std::pair<id_t, int32_t>> imgs {};
+    //How many threads parse imgs
+    size_t thread_count {std::max<size_t>(std::thread::hardware_concurrency(), 1)};
     size_t file_start {};
     std::vector<id_t> uol_path;
     std::vector<std::vector<id_t>> uols;
     std::vector<uint64_t> bitmaps {};
     std::vector<uint64_t> sounds {};
+    //Bitmap stuff
+    //LZ4 HC output is plain LZ4, so it shares the lz4 codec
+    enum class bitmap_encoding {
+        lz4,
+        lz4hc,
+        zstd,
+        raw
+    };
+    //Points into one of the conversion buffers, so it is only valid until the next bitmap is converted
+    struct bitmap_payload {
+        void const * data;
+        uint32_t size;
+        bitmap::format format;
+        bitmap::codec codec;
+        uint16_t width, height;
+    };
+#pragma pack(push, 1)
+    struct bitmap_alpha {
+        uint16_t left, top, right, bottom;
+        uint32_t flags;
+    };
+#pragma pack(pop)
+    bool bcn_output {false};
+    //Which encoding BGRA bitmaps get, by path prefix, with later rules taking precedence
+    std::vector<std::pair<std::string, bitmap_encoding>> encoding_rules {{"", bitmap_encoding::lz4}};
+    //BGRA bitmaps smaller than this many bytes are stored raw regardless of the rules
+    size_t raw_below {0};
+    std::vector<std::string> bitmap_paths {};
+    std::vector<bitmap_alpha> bitmap_alphas {};
+    //Audio stuff
+    enum class audio_codec : uint8_t {
+        unknown = 0,
+        pcm = 1,
+        mp3 = 2
+    };
+    struct audio_payload {
+        void const * data;
+        uint32_t size;
+    };
+#pragma pack(push, 1)
+    struct audio_info {
+        uint32_t sample_rate;
+        uint32_t duration;
+        uint16_t channels;
+        uint16_t bits_per_sample;
+        audio_codec codec;
+        uint8_t reserved;
+        uint16_t header_length;
+    };
+#pragma pack(pop)
+    //MP3 sounds shorter than this many milliseconds are decoded to PCM
+    uint32_t pcm_below {0};
+    std::vector<uint32_t> sound_durations {};
+    std::vector<audio_info> audio_infos {};
+    std::vector<uint32_t> audio_lengths {};
+    bool front_coded_strings {false};
+    nx_writer::layout node_layout {nx_writer::layout::depth_first};
+    //The writer only stores identical payloads once, so nodes are pointed at whichever id it hands back
+    std::vector<id_t> bitmap_remap {};
+    std::vector<id_t> audio_remap {};
+    uint64_t duplicate_bitmap_bytes {0};
+    uint64_t duplicate_audio_bytes {0};
+    size_t decoded_audio {0};
+    size_t reused_strings {0};
+    uint64_t reused_string_bytes {0};
+    std::vector<uint8_t> decrypt_buf {};
+    std::vector<uint8_t> inflate_buf {};
+    std::vector<uint8_t> pixel_buf {};
+    std::vector<uint8_t> bc1_check_buf {};
 
 
     id_t add_string(char8_t const * data, strsize_t size) {
-        hash_t hash {2166136261UL};
-        char8_t const * s {data};
-        for (strsize_t i {size}; i; --i, ++s) {
-            hash ^= static_cast<hash_t>(*s);
-            hash *= 16777619UL;
-        }
-        id_t & id {string_map[hash]};
-        if (id != 0) return id;
-        id = static_cast<id_t>(strings.size());
-        strings.push_back({static_cast<char8_t *>(alloc::small(size)), size});
-        memcpy(strings.back().data, data, size);
-        return id;
+        return strings.add(data, size);
     }
-    id_t read_enc_string() {
-        strsize_t slen {};
-        int8_t len {in::read<int8_t>()};
-        if (len > 0) {
-            slen = static_cast<strsize_t>(len == 127 ? in::read<int32_t>() : len);
-            char16_t const * ows {reinterpret_cast<char16_t const *>(in::offset)};
-            in::skip(slen * 2u);
-            char16_t * ws {wstr_buf};
-            uint16_t mask {0xAAAA};
-            char16_t const * key {reinterpret_cast<char16_t const *>(*cur_key)};
-            for (strsize_t i {slen}; i; --i, ++mask, ++ows, ++ws, ++key) {
-                *ws = static_cast<char16_t>(*ows ^ *key ^ mask);
+    void mask_keys() {
+        for (size_t k {0}; k < 3; ++k) {
+            key_t const * key {*keys[k]};
+            string_key & sk {string_keys[k]};
+            for (size_t i {0}; i < 0x10000; ++i) {
+                sk.narrow[i] = static_cast<uint8_t>(key[i] ^ (0xAA + i));
+                uint16_t const mask {static_cast<uint16_t>(0xAAAA + i / 2)};
+                sk.wide[i] = static_cast<uint8_t>(key[i] ^ (i & 1 ? mask >> 8 : mask));
             }
-            mbstate_t state {};
-            char16_t const * fnext {};
-            char8_t * tnext {};
-            convert.out(state, wstr_buf, wstr_buf + slen, fnext, str_buf, str_buf + 0x10000, tnext);
-            return add_string(str_buf, static_cast<strsize_t>(tnext - str_buf));
         }
-        if (len < 0) {
-            slen = static_cast<strsize_t>(len == -128 ? in::read<int32_t>() : -len);
-            char8_t const * os {reinterpret_cast<char8_t const *>(in::offset)};
-            in::skip(slen);
-            char8_t * s {str_buf};
-            uint8_t mask {0xAA};
-            char8_t const * key {reinterpret_cast<char8_t const *>(*cur_key)};
-            for (strsize_t i {slen}; i; --i, ++mask, ++os, ++s, ++key) {
-                *s = static_cast<char8_t>(*os ^ *key ^ mask);
+    }
+    string_key const * masked(key_table * key) {
+        return &string_keys[std::find(std::begin(keys), std::end(keys), key) - std::begin(keys)];
+    }
+    //String decryption and UTF-16 transcoding
+    //Each has a plain version, which is what builds without SSE2 use and what --bench-strings compares against
+    void decrypt_scalar(void const * src, uint8_t const * key, size_t size, void * dst) {
+        uint8_t const * s {static_cast<uint8_t const *>(src)};
+        uint8_t * d {static_cast<uint8_t *>(dst)};
+        for (size_t i {0}; i < size; ++i) d[i] = s[i] ^ key[i];
+    }
+    void decrypt(void const * src, uint8_t const * key, size_t size, void * dst) {
+#ifdef WZTONX_SSE2
+        uint8_t const * s {static_cast<uint8_t const *>(src)};
+        uint8_t * d {static_cast<uint8_t *>(dst)};
+        size_t const blocks {size & ~size_t {15}};
+        for (size_t i {0}; i < blocks; i += 16) {
+            __m128i const v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<__m128i const *>(s + i)),
+                _mm_loadu_si128(reinterpret_cast<__m128i const *>(key + i)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(d + i), v);
+        }
+        decrypt_scalar(s + blocks, key + blocks, size - blocks, d + blocks);
+#else
+        decrypt_scalar(src, key, size, dst);
+#endif
+    }
+    //Writes one character as UTF-8, joining surrogate pairs and replacing unpaired surrogates with U+FFFD
+    void encode_utf8(char16_t const *& s, char16_t const * end, char8_t *& d) {
+        uint32_t c {*s++};
+        if (c >= 0xD800 && c < 0xE000) {
+            if (c < 0xDC00 && s < end && *s >= 0xDC00 && *s < 0xE000) c = 0x10000 + ((c - 0xD800) << 10) + (*s++ - 0xDC00);
+            else c = 0xFFFD;
+        }
+        if (c < 0x80) {
+            *d++ = static_cast<char8_t>(c);
+        } else if (c < 0x800) {
+            *d++ = static_cast<char8_t>(0xC0 | c >> 6);
+            *d++ = static_cast<char8_t>(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            *d++ = static_cast<char8_t>(0xE0 | c >> 12);
+            *d++ = static_cast<char8_t>(0x80 | (c >> 6 & 0x3F));
+            *d++ = static_cast<char8_t>(0x80 | (c & 0x3F));
+        } else {
+            *d++ = static_cast<char8_t>(0xF0 | c >> 18);
+            *d++ = static_cast<char8_t>(0x80 | (c >> 12 & 0x3F));
+            *d++ = static_cast<char8_t>(0x80 | (c >> 6 & 0x3F));
+            *d++ = static_cast<char8_t>(0x80 | (c & 0x3F));
+        }
+    }
+    //Both return how many bytes they wrote, which is at most 3 for each character
+    size_t utf16_to_utf8_scalar(char16_t const * src, size_t size, char8_t * dst) {
+        char8_t * d {dst};
+        for (char16_t const * s {src}, * end {src + size}; s < end;) encode_utf8(s, end, d);
+        return static_cast<size_t>(d - dst);
+    }
+    //Runs of 8 ASCII characters, which is nearly every string, are narrowed in one go
+    size_t utf16_to_utf8(char16_t const * src, size_t size, char8_t * dst) {
+        char8_t * d {dst};
+        char16_t const * s {src};
+        char16_t const * const end {src + size};
+#ifdef WZTONX_SSE2
+        __m128i const high = _mm_set1_epi16(static_cast<short>(0xFF80));
+        __m128i const zero = _mm_setzero_si128();
+#endif
+        while (s < end) {
+#ifdef WZTONX_SSE2
+            //Only worth trying where the next character is ASCII, so text that isn't stays on the plain path
+            if (*s < 0x80 && end - s >= 8) {
+                __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(s));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, high), zero)) == 0xFFFF) {
+                    _mm_storel_epi64(reinterpret_cast<__m128i *>(d), _mm_packus_epi16(v, v));
+                    s += 8, d += 8;
+                    continue;
+                }
             }
-            return add_string(str_buf, slen);
+#endif
+            encode_utf8(s, end, d);
         }
-        return 0;
+        return static_cast<size_t>(d - dst);
     }
-    id_t read_prop_string(size_t offset) {
-        uint8_t a {in::read<uint8_t>()};
-        switch (a) {
-        case 0x00:
-        case 0x73:
-            return read_enc_string();
-        case 0x01:
-        case 0x1B:{
-            size_t o {in::read<int32_t>() + offset};
-            size_t p {in::tell()};
-            in::seek(o);
-            id_t s {read_enc_string()};
-            in::seek(p);
-            return s;
-                  }
-        default:
-            throw std::runtime_error {"Unknown property string type: " + std::to_string(a)};
+    //Decrypts the string at o into buf as UTF-8, moving o past it, and returns its length
+    //wbuf must have room for 0x8000 characters and buf for 0x18000 bytes
+    strsize_t decode_string(char const *& o, string_key const & key, char16_t * wbuf, char8_t * buf) {
+        int8_t len {in::read<int8_t>(o)};
+        if (len > 0) {
+            size_t const slen {static_cast<size_t>(len == 127 ? in::read<int32_t>(o) : len)};
+            if (slen > 0x8000) throw std::runtime_error {"String too long: " + std::to_string(slen)};
+            decrypt(o, key.wide, slen * 2, wbuf);
+            o += slen * 2;
+            size_t const size {utf16_to_utf8(wbuf, slen, buf)};
+            if (size > 0xFFFF) throw std::runtime_error {"String too long: " + std::to_string(size)};
+            return static_cast<strsize_t>(size);
+        }
+        if (len < 0) {
+            size_t const slen {static_cast<size_t>(len == -128 ? in::read<int32_t>(o) : -len)};
+            if (slen > 0xFFFF) throw std::runtime_error {"String too long: " + std::to_string(slen)};
+            decrypt(o, key.narrow, slen, buf);
+            o += slen;
+            return static_cast<strsize_t>(slen);
         }
+        return 0;
     }
-    void deduce_key() {
-        int8_t len {in::read<int8_t>()};
+    id_t read_enc_string() {
+        strsize_t const size {decode_string(in::offset, *cur_string_key, wstr_buf, str_buf)};
+        return size ? add_string(str_buf, size) : 0;
+    }
+    //Finds the key that decrypts the string at o to plain ASCII, moving o past it
+    key_table * find_key(char const *& o) {
+        int8_t len {in::read<int8_t>(o)};
         if (len >= 0) throw std::runtime_error {"I give up"};
-        strsize_t slen {static_cast<strsize_t>(len == -128 ? in::read<int32_t>() : -len)};
-        cur_key = nullptr;
+        strsize_t slen {static_cast<strsize_t>(len == -128 ? in::read<int32_t>(o) : -len)};
+        key_table * found {nullptr};
         for (auto key : keys) {
-            char8_t const * os {reinterpret_cast<char8_t const *>(in::offset)};
+            char8_t const * os {reinterpret_cast<char8_t const *>(o)};
             uint8_t mask {0xAA};
             char8_t const * k {reinterpret_cast<char8_t const *>(*key)};
             bool valid {true};
@@ -331,10 +483,15 @@ namespace nl {
                 char8_t c {static_cast<char8_t>(*os ^ *k ^ mask)};
                 if (c < 0x20 || c >= 0x80) valid = false;
             }
-            if (valid) cur_key = key;
+            if (valid) found = key;
         }
-        if (!cur_key) throw std::runtime_error {"Failed to identify the locale"};
-        in::skip(slen);
+        if (!found) throw std::runtime_error {"Failed to identify the locale"};
+        o += slen;
+        return found;
+    }
+    void deduce_key() {
+        cur_key = find_key(in::offset);
+        cur_string_key = masked(cur_key);
     }
     void sort_nodes(id_t first, id_t count) {
         std::sort(nodes.begin() + first, nodes.begin() + first + count, [](node const & n1, node const & n2) {
@@ -365,7 +522,7 @@ namespace nl {
         if (parent_node == 0) return 0;
         node & n {nodes[parent_node]};
         std::vector<node>::iterator it {std::lower_bound(nodes.begin() + n.children, nodes.begin() + n.children + n.num, str, [&](node const & n, string s) {
-            string & sn {strings[n.name]};
+            string const & sn {strings[n.name]};
             int r {strncmp(sn.data, s.data, std::min(sn.size, s.size))};
             return r < 0 || r == 0 && sn.size < s.size;
         })};
@@ -376,7 +533,7 @@ namespace nl {
         node & n {nodes[uol.back()]};
         uol.pop_back();
         if (n.data_type != node::type::uol) throw std::runtime_error {"Welp. I failed."};
-        string & s {strings[n.data.string]};
+        string const & s {strings[n.data.string]};
         strsize_t b {0};
         for (strsize_t i {0}; i < s.size; ++i) if (s.data[i] == '/') {
             if (i - b == 2 && strncmp(s.data + b, "..", 2) == 0) uol.pop_back();
@@ -437,113 +594,718 @@ namespace nl {
         for (auto & it : directories) directory(it);
         nodes_to_sort.emplace_back(ni, count);
     }
-    void sub_property(id_t, size_t);
-    void extended_property(id_t prop_node, size_t offset) {
-        node & n {nodes[prop_node]};
-        id_t s {read_prop_string(offset)};
-        string const & st {strings[s]};
-        if (!strncmp(st.data, "Property", st.size)) {
-            in::skip(2);
-            sub_property(prop_node, offset);
-        } else if (!strncmp(st.data, "Canvas", st.size)) {
-            in::skip(1);
-            if (in::read<uint8_t>() == 1) {
-                in::skip(2);
-                sub_property(prop_node, offset);
+    //Parses imgs into tables of its own, so that several can run on different threads at once
+    //Each img gets a segment of the tables, and merge() appends the segments to the global tables in the order of the imgs,
+    //so the output is the same whatever the number of threads and whichever thread parsed which img
+    class img_parser {
+    public:
+        struct segment {
+            id_t img_node;
+            //Where the segment starts in each table, the first node standing in for the img node itself
+            id_t first_node;
+            size_t first_sort;
+            id_t first_bitmap;
+            id_t first_sound;
+            //And where it ends
+            id_t last_node;
+            size_t last_sort;
+            id_t last_bitmap;
+            id_t last_sound;
+        };
+        img_parser() : m_offset {nullptr}, m_key {nullptr},
+            m_wstr_buf(0x8000), m_str_buf(0x18000), m_cache(0x400, cached_string {0, 0, 0}), m_cached {0}, m_img {0},
+            m_reused_strings {0}, m_reused_string_bytes {0} {
+            add_string("", 0);
+        }
+        //Returns the index of the segment holding the img
+        size_t parse(id_t img_node, size_t offset) {
+            segment s {img_node, static_cast<id_t>(m_nodes.size()), m_sorts.size(),
+                static_cast<id_t>(m_bitmaps.size()), static_cast<id_t>(m_sounds.size()), 0, 0, 0, 0};
+            m_nodes.emplace_back();
+            //References never point outside their own img, so moving on to the next one empties the cache
+            ++m_img;
+            m_cached = 0;
+            m_offset = in::base + offset;
+            skip(1);
+            m_key = masked(find_key(m_offset));
+            skip(2);
+            sub_property(s.first_node, offset);
+            s.last_node = static_cast<id_t>(m_nodes.size());
+            s.last_sort = m_sorts.size();
+            s.last_bitmap = static_cast<id_t>(m_bitmaps.size());
+            s.last_sound = static_cast<id_t>(m_sounds.size());
+            m_segments.push_back(s);
+            return m_segments.size() - 1;
+        }
+        //Appends a segment to the global tables, remapping its nodes, strings, bitmaps and audio to the global ids
+        void merge(size_t index) {
+            segment const & s {m_segments[index]};
+            id_t const base {static_cast<id_t>(nodes.size())};
+            auto const remap = [&](id_t n) {
+                return base + n - s.first_node - 1;
+            };
+            id_t const bitmap_base {static_cast<id_t>(bitmaps.size())};
+            id_t const sound_base {static_cast<id_t>(sounds.size())};
+            node const & root {m_nodes[s.first_node]};
+            nodes[s.img_node].num = root.num;
+            nodes[s.img_node].children = root.num ? remap(root.children) : 0;
+            for (id_t i {s.first_node + 1}; i < s.last_node; ++i) {
+                node n {m_nodes[i]};
+                n.name = global_string(n.name);
+                n.children = n.num ? remap(n.children) : 0;
+                switch (n.data_type) {
+                case node::type::string:
+                case node::type::uol: n.data.string = global_string(n.data.string); break;
+                case node::type::bitmap: n.data.bitmap.id = n.data.bitmap.id - s.first_bitmap + bitmap_base; break;
+                case node::type::audio: n.data.audio.id = n.data.audio.id - s.first_sound + sound_base; break;
+                default: break;
+                }
+                nodes.push_back(n);
             }
-            node & n {nodes[prop_node]};
-            n.data_type = node::type::bitmap;
-            n.data.bitmap.id = static_cast<uint32_t>(bitmaps.size());
-            bitmaps.push_back(in::tell());
-            n.data.bitmap.width = static_cast<uint16_t>(in::read_cint());
-            n.data.bitmap.height = static_cast<uint16_t>(in::read_cint());
-        } else if (!strncmp(st.data, "Shape2D#Vector2D", st.size)) {
-            n.data_type = node::type::vector;
-            n.data.vector[0] = in::read_cint();
-            n.data.vector[1] = in::read_cint();
-        } else if (!strncmp(st.data, "Shape2D#Convex2D", st.size)) {
-            id_t count {static_cast<id_t>(in::read_cint())};
-            id_t ni {static_cast<id_t>(nodes.size())};
+            for (size_t i {s.first_sort}; i < s.last_sort; ++i) nodes_to_sort.emplace_back(remap(m_sorts[i].first), m_sorts[i].second);
+            bitmaps.insert(bitmaps.end(), m_bitmaps.begin() + s.first_bitmap, m_bitmaps.begin() + s.last_bitmap);
+            sounds.insert(sounds.end(), m_sounds.begin() + s.first_sound, m_sounds.begin() + s.last_sound);
+            sound_durations.insert(sound_durations.end(), m_durations.begin() + s.first_sound, m_durations.begin() + s.last_sound);
+        }
+        //How many string references were answered from the cache, and how many bytes of UTF-8 that spared decoding
+        size_t reused_strings() const {
+            return m_reused_strings;
+        }
+        uint64_t reused_string_bytes() const {
+            return m_reused_string_bytes;
+        }
+    private:
+        img_parser(img_parser const &);//Todo: Replace with = delete once VS has support for it.
+        img_parser & operator=(img_parser const &);//Todo: Replace with = delete once VS has support for it.
+        //Open addressing from the offset of each property string in the current img to its id
+        //Entries are stamped with the img they belong to, so emptying the cache doesn't have to touch it
+        struct cached_string {
+            uint32_t offset;
+            uint32_t img;
+            id_t id;
+        };
+        size_t tell() {
+            return static_cast<size_t>(m_offset - in::base);
+        }
+        void seek(size_t n) {
+            m_offset = in::base + n;
+        }
+        void skip(size_t n) {
+            m_offset += n;
+        }
+        template <typename T> T read() {
+            return in::read<T>(m_offset);
+        }
+        int32_t read_cint() {
+            return in::read_cint(m_offset);
+        }
+        id_t add_string(char8_t const * data, strsize_t size) {
+            id_t const id {m_strings.add(data, size)};
+            if (id == m_global.size()) m_global.push_back(0);
+            return id;
+        }
+        //Strings only get global ids once a merged node uses them, in the order the nodes are merged in
+        id_t global_string(id_t local) {
+            if (!local) return 0;
+            id_t & id {m_global[local]};
+            if (!id) id = nl::add_string(m_strings[local].data, m_strings[local].size);
+            return id;
+        }
+        id_t read_enc_string() {
+            strsize_t const size {decode_string(m_offset, *m_key, m_wstr_buf.data(), m_str_buf.data())};
+            return size ? add_string(m_str_buf.data(), size) : 0;
+        }
+        //Gives the entry for the string at offset o in the current img, or the slot it would go in if its img is not the current one
+        cached_string & find_cached(uint32_t o) {
+            size_t const mask {m_cache.size() - 1};
+            uint32_t const h {o * 0x9E3779B1U};
+            for (size_t i {(h ^ h >> 16) & mask};; i = (i + 1) & mask) {
+                cached_string & c {m_cache[i]};
+                if (c.img != m_img || c.offset == o) return c;
+            }
+        }
+        void cache_string(uint32_t o, id_t s) {
+            cached_string & c {find_cached(o)};
+            if (c.img == m_img) return;
+            c = cached_string {o, m_img, s};
+            //Kept at most half full, and only the entries of the current img move over
+            if (++m_cached * 2 <= m_cache.size()) return;
+            std::vector<cached_string> cache(m_cache.size() * 2, cached_string {0, 0, 0});
+            cache.swap(m_cache);
+            for (auto const & e : cache) if (e.img == m_img) find_cached(e.offset) = e;
+        }
+        //Property strings are remembered by offset, so the references back to them don't decode them all over again
+        id_t read_prop_string(size_t offset) {
+            uint8_t a {read<uint8_t>()};
+            switch (a) {
+            case 0x00:
+            case 0x73:{
+                uint32_t const o {static_cast<uint32_t>(tell() - offset)};
+                id_t const s {read_enc_string()};
+                cache_string(o, s);
+                return s;
+                      }
+            case 0x01:
+            case 0x1B:{
+                uint32_t const o {static_cast<uint32_t>(read<int32_t>())};
+                cached_string const & c {find_cached(o)};
+                if (c.img == m_img) {
+                    ++m_reused_strings;
+                    m_reused_string_bytes += m_strings[c.id].size;
+                    return c.id;
+                }
+                size_t p {tell()};
+                seek(o + offset);
+                id_t s {read_enc_string()};
+                seek(p);
+                cache_string(o, s);
+                return s;
+                      }
+            default:
+                throw std::runtime_error {"Unknown property string type: " + std::to_string(a)};
+            }
+        }
+        void extended_property(id_t prop_node, size_t offset) {
+            node & n {m_nodes[prop_node]};
+            id_t s {read_prop_string(offset)};
+            string const & st {m_strings[s]};
+            if (!strncmp(st.data, "Property", st.size)) {
+                skip(2);
+                sub_property(prop_node, offset);
+            } else if (!strncmp(st.data, "Canvas", st.size)) {
+                skip(1);
+                if (read<uint8_t>() == 1) {
+                    skip(2);
+                    sub_property(prop_node, offset);
+                }
+                node & n {m_nodes[prop_node]};
+                n.data_type = node::type::bitmap;
+                n.data.bitmap.id = static_cast<uint32_t>(m_bitmaps.size());
+                m_bitmaps.push_back(tell());
+                n.data.bitmap.width = static_cast<uint16_t>(read_cint());
+                n.data.bitmap.height = static_cast<uint16_t>(read_cint());
+            } else if (!strncmp(st.data, "Shape2D#Vector2D", st.size)) {
+                n.data_type = node::type::vector;
+                n.data.vector[0] = read_cint();
+                n.data.vector[1] = read_cint();
+            } else if (!strncmp(st.data, "Shape2D#Convex2D", st.size)) {
+                id_t count {static_cast<id_t>(read_cint())};
+                id_t ni {static_cast<id_t>(m_nodes.size())};
+                n.num = static_cast<uint16_t>(count);
+                n.children = ni;
+                m_nodes.resize(m_nodes.size() + count);
+                for (id_t i {0}; i < count; ++i) {
+                    node & nn {m_nodes[ni + i]};
+                    std::string es {std::to_string(i)};
+                    nn.name = add_string(es.c_str(), static_cast<strsize_t>(es.size()));
+                    extended_property(ni + i, offset);
+                }
+                m_sorts.emplace_back(ni, count);
+            } else if (!strncmp(st.data, "Sound_DX8", st.size)) {
+                n.data_type = node::type::audio;
+                n.data.audio.id = static_cast<uint32_t>(m_sounds.size());
+                skip(1);//Always 0
+                int32_t const length {read_cint()};
+                m_durations.push_back(static_cast<uint32_t>(read_cint()));
+                //The audio keeps its Sound_DX8 header, which is 51 bytes followed by a length prefixed wave format
+                m_sounds.push_back(tell());
+                uint8_t const format_length {reinterpret_cast<uint8_t const *>(m_offset)[51]};
+                n.data.audio.length = static_cast<uint32_t>(52 + format_length + length);
+            } else if (!strncmp(st.data, "UOL", st.size)) {
+                skip(1);
+                n.data_type = node::type::uol;
+                n.data.string = read_prop_string(offset);
+            } else throw std::runtime_error {"Unknown sub property type: " + std::string {st.data, st.size}};
+        }
+        void sub_property(id_t prop_node, size_t offset) {
+            node & n {m_nodes[prop_node]};
+            id_t count {static_cast<id_t>(read_cint())};
+            id_t ni {static_cast<id_t>(m_nodes.size())};
             n.num = static_cast<uint16_t>(count);
             n.children = ni;
-            nodes.resize(nodes.size() + count);
+            m_nodes.resize(m_nodes.size() + count);
             for (id_t i {0}; i < count; ++i) {
-                node & nn {nodes[ni + i]};
-                std::string es {std::to_string(i)};
-                nn.name = add_string(es.c_str(), static_cast<strsize_t>(es.size()));
-                extended_property(ni, offset);
+                node & nn {m_nodes[ni + i]};
+                nn.name = read_prop_string(offset);
+                uint8_t type {read<uint8_t>()};
+                switch (type) {
+                case 0x00://Turning null nodes into integers with an id. Useful for zmap.img
+                    nn.data_type = node::type::integer;
+                    nn.data.integer = i;
+                    break;
+                case 0x0B:
+                case 0x02:
+                    nn.data_type = node::type::integer;
+                    nn.data.integer = read<uint16_t>();
+                    break;
+                case 0x03:
+                    nn.data_type = node::type::integer;
+                    nn.data.integer = read_cint();
+                    break;
+                case 0x04:
+                    nn.data_type = node::type::real;
+                    nn.data.real = read<uint8_t>() == 0x80 ? read<float>() : 0.;
+                    break;
+                case 0x05:
+                    nn.data_type = node::type::real;
+                    nn.data.real = read<double>();
+                    break;
+                case 0x08:
+                    nn.data_type = node::type::string;
+                    nn.data.string = read_prop_string(offset);
+                    break;
+                case 0x09:{
+                    size_t p {read<int32_t>() + tell()};
+                    extended_property(ni + i, offset);
+                    seek(p);
+                    break;
+                          }
+                default:
+                    throw std::runtime_error {"Unknown sub property type: " + std::to_string(type)};
+                }
             }
-            nodes_to_sort.emplace_back(ni, count);
-        } else if (!strncmp(st.data, "Sound_DX8", st.size)) {
-            n.data_type = node::type::audio;
-            n.data.audio.id = static_cast<uint32_t>(sounds.size());
-            sounds.push_back(in::tell());
-            in::skip(1);//Always 0
-            n.data.audio.length = static_cast<uint32_t>(in::read_cint());
-        } else if (!strncmp(st.data, "UOL", st.size)) {
-            in::skip(1);
-            n.data_type = node::type::uol;
-            n.data.string = read_prop_string(offset);
-        } else throw std::runtime_error {"Unknown sub property type: " + std::string {st.data, st.size}};
-    }
-    void sub_property(id_t prop_node, size_t offset) {
-        node & n {nodes[prop_node]};
-        id_t count {static_cast<id_t>(in::read_cint())};
-        id_t ni {static_cast<id_t>(nodes.size())};
-        n.num = static_cast<uint16_t>(count);
-        n.children = ni;
-        nodes.resize(nodes.size() + count);
-        for (id_t i {0}; i < count; ++i) {
-            node & nn {nodes[ni + i]};
-            nn.name = read_prop_string(offset);
-            uint8_t type {in::read<uint8_t>()};
-            switch (type) {
-            case 0x00://Turning null nodes into integers with an id. Useful for zmap.img
-                nn.data_type = node::type::integer;
-                nn.data.integer = i;
-                break;
-            case 0x0B:
-            case 0x02:
-                nn.data_type = node::type::integer;
-                nn.data.integer = in::read<uint16_t>();
-                break;
-            case 0x03:
-                nn.data_type = node::type::integer;
-                nn.data.integer = in::read_cint();
-                break;
-            case 0x04:
-                nn.data_type = node::type::real;
-                nn.data.real = in::read<uint8_t>() == 0x80 ? in::read<float>() : 0.;
-                break;
-            case 0x05:
-                nn.data_type = node::type::real;
-                nn.data.real = in::read<double>();
-                break;
-            case 0x08:
-                nn.data_type = node::type::string;
-                nn.data.string = read_prop_string(offset);
-                break;
-            case 0x09:{
-                size_t p {in::read<int32_t>() + in::tell()};
-                extended_property(ni + i, offset);
-                in::seek(p);
-                break;
-                      }
-            default:
-                throw std::runtime_error {"Unknown sub property type: " + std::to_string(type)};
+            m_sorts.emplace_back(ni, count);
+        }
+        char const * m_offset;
+        string_key const * m_key;
+        std::vector<char16_t> m_wstr_buf;
+        std::vector<char8_t> m_str_buf;
+        std::vector<node> m_nodes;
+        string_table m_strings;
+        //The global id of each string, or 0 if no merged node has used it yet
+        std::vector<id_t> m_global;
+        std::vector<std::pair<id_t, id_t>> m_sorts;
+        std::vector<uint64_t> m_bitmaps;
+        std::vector<uint64_t> m_sounds;
+        std::vector<uint32_t> m_durations;
+        std::vector<segment> m_segments;
+        std::vector<cached_string> m_cache;
+        size_t m_cached;
+        uint32_t m_img;
+        size_t m_reused_strings;
+        uint64_t m_reused_string_bytes;
+    };
+    //Parses every img on thread_count threads, then merges them in order
+    //The imgs follow the directories back to back, so each starts where the one before it ends
+    void parse_imgs() {
+        std::vector<size_t> offsets {};
+        size_t offset {in::tell()};
+        for (auto const & it : imgs) {
+            offsets.push_back(offset);
+            offset += static_cast<size_t>(it.second);
+        }
+        size_t const threads {std::max<size_t>(std::min(thread_count, imgs.size()), 1)};
+        std::vector<std::unique_ptr<img_parser>> parsers {};
+        for (size_t t {0}; t < threads; ++t) parsers.emplace_back(new img_parser {});
+        //Which parser has each img, and where
+        std::vector<std::pair<img_parser *, size_t>> parsed(imgs.size());
+        std::atomic<size_t> next {0};
+        std::vector<std::exception_ptr> errors(threads);
+        std::vector<std::thread> workers {};
+        for (size_t t {0}; t < threads; ++t) workers.emplace_back([&, t] {
+            try {
+                for (size_t i; (i = next++) < imgs.size();) parsed[i] = {parsers[t].get(), parsers[t]->parse(imgs[i].first, offsets[i])};
+            } catch (...) {
+                errors[t] = std::current_exception();
+                next = imgs.size();
             }
+        });
+        for (std::thread & w : workers) w.join();
+        for (std::exception_ptr const & e : errors) if (e) std::rethrow_exception(e);
+        for (auto const & p : parsed) p.first->merge(p.second);
+        for (auto const & p : parsers) {
+            reused_strings += p->reused_strings();
+            reused_string_bytes += p->reused_string_bytes();
         }
-        nodes_to_sort.emplace_back(ni, count);
+        in::seek(offset);
+    }
+    //Canvas data is usually a zlib stream, but some files split it into blocks xored with the key
+    void inflate_bitmap(uint8_t const * data, size_t size, size_t expected) {
+        if (size < 2 || (data[0] & 0x0f) != 8 || (data[0] << 8 | data[1]) % 31 != 0) {
+            decrypt_buf.clear();
+            uint8_t const * const end {data + size};
+            while (data + 4 <= end) {
+                int32_t block {*reinterpret_cast<int32_t const *>(data)};
+                data += 4;
+                if (block < 0 || block > end - data) block = static_cast<int32_t>(end - data);
+                for (int32_t i {0}; i < block; ++i) decrypt_buf.push_back(static_cast<uint8_t>(data[i] ^ (*cur_key)[i]));
+                data += block;
+            }
+            data = decrypt_buf.data();
+            size = decrypt_buf.size();
+        }
+        inflate_buf.assign(expected, 0);
+        z_stream strm {};
+        strm.next_in = const_cast<Bytef *>(data);
+        strm.avail_in = static_cast<uInt>(size);
+        strm.next_out = inflate_buf.data();
+        strm.avail_out = static_cast<uInt>(expected);
+        if (inflateInit(&strm) != Z_OK) throw std::runtime_error {"Failed to initialize zlib"};
+        //Truncated bitmaps exist in the wild, so whatever didn't decompress is left transparent
+        inflate(&strm, Z_FINISH);
+        inflateEnd(&strm);
+    }
+    //Converts the inflated canvas to 32-bit BGRA in pixel_buf
+    void expand_bitmap(int32_t format, uint16_t width, uint16_t height) {
+        size_t const pixels {static_cast<size_t>(width) * height};
+        pixel_buf.resize(pixels * 4);
+        uint8_t const * s {inflate_buf.data()};
+        uint8_t * d {pixel_buf.data()};
+        switch (format) {
+        case 1:
+            for (size_t i {pixels}; i; --i, s += 2, d += 4) {
+                d[0] = static_cast<uint8_t>((s[0] & 0x0f) * 0x11);
+                d[1] = static_cast<uint8_t>((s[0] >> 4) * 0x11);
+                d[2] = static_cast<uint8_t>((s[1] & 0x0f) * 0x11);
+                d[3] = static_cast<uint8_t>((s[1] >> 4) * 0x11);
+            }
+            break;
+        case 2:
+            memcpy(d, s, pixels * 4);
+            break;
+        case 513:
+            for (size_t i {pixels}; i; --i, s += 2, d += 4) {
+                uint16_t const c {static_cast<uint16_t>(s[0] | s[1] << 8)};
+                d[0] = static_cast<uint8_t>((c & 0x1f) << 3 | (c & 0x1f) >> 2);
+                d[1] = static_cast<uint8_t>((c >> 5 & 0x3f) << 2 | (c >> 5 & 0x3f) >> 4);
+                d[2] = static_cast<uint8_t>((c >> 11) << 3 | (c >> 11) >> 2);
+                d[3] = 0xff;
+            }
+            break;
+        case 517:
+            //Each 16-bit color fills a 16x16 block
+            for (size_t y {0}; y < height; ++y) for (size_t x {0}; x < width; ++x, d += 4) {
+                uint8_t const * const p {s + ((y >> 4) * ((width + 15u) >> 4) + (x >> 4)) * 2};
+                uint16_t const c {static_cast<uint16_t>(p[0] | p[1] << 8)};
+                d[0] = static_cast<uint8_t>((c & 0x1f) << 3 | (c & 0x1f) >> 2);
+                d[1] = static_cast<uint8_t>((c >> 5 & 0x3f) << 2 | (c >> 5 & 0x3f) >> 4);
+                d[2] = static_cast<uint8_t>((c >> 11) << 3 | (c >> 11) >> 2);
+                d[3] = 0xff;
+            }
+            break;
+        case 1026:
+            bcn::decompress_bc2(s, d, width, height);
+            break;
+        case 2050:
+            bcn::decompress_bc3(s, d, width, height);
+            break;
+        default:
+            throw std::runtime_error {"Unknown bitmap format: " + std::to_string(format)};
+        }
+    }
+    size_t inflated_size(int32_t format, uint16_t width, uint16_t height) {
+        size_t const pixels {static_cast<size_t>(width) * height};
+        switch (format) {
+        case 1: return pixels * 2;
+        case 2: return pixels * 4;
+        case 513: return pixels * 2;
+        case 517: return ((width + 15u) >> 4) * ((height + 15u) >> 4) * 2;
+        case 1026: return bcn::length(width, height, 16);
+        case 2050: return bcn::length(width, height, 16);
+        default: throw std::runtime_error {"Unknown bitmap format: " + std::to_string(format)};
+        }
+    }
+    //Tight bounds of the visible pixels plus whether the bitmap is opaque (1) or has partial alpha (2)
+    bitmap_alpha compute_alpha(uint16_t width, uint16_t height) {
+        bitmap_alpha r {width, height, 0, 0, 1};
+        uint8_t const * a {pixel_buf.data() + 3};
+        for (uint16_t y {0}; y < height; ++y) for (uint16_t x {0}; x < width; ++x, a += 4) {
+            if (*a != 0xff) r.flags &= ~1u;
+            if (*a == 0) continue;
+            if (*a != 0xff) r.flags |= 2;
+            if (x < r.left) r.left = x;
+            if (y < r.top) r.top = y;
+            if (x >= r.right) r.right = static_cast<uint16_t>(x + 1);
+            if (y >= r.bottom) r.bottom = static_cast<uint16_t>(y + 1);
+        }
+        if (r.right == 0) r.left = r.top = 0;
+        return r;
+    }
+    bitmap_payload make_payload(void const * data, size_t size, bitmap::format format, uint16_t width, uint16_t height,
+        bitmap::codec codec = bitmap::codec::raw) {
+        return {data, static_cast<uint32_t>(size), format, codec, width, height};
     }
-    void img(id_t img_node, int32_t size) {
-        size_t p {in::tell()};
+    //Only needed when there are rules to match against
+    void find_bitmap_paths(id_t n, std::string const & path) {
+        node const & nn {nodes[n]};
+        if (nn.data_type == node::type::bitmap && bitmap_paths[nn.data.bitmap.id].empty()) bitmap_paths[nn.data.bitmap.id] = path;
+        for (id_t i {0}; i < nn.num; ++i) {
+            string const & s {strings[nodes[nn.children + i].name]};
+            find_bitmap_paths(nn.children + i, path + (path.empty() ? "" : "/") + std::string {s.data, s.size});
+        }
+    }
+    bitmap_encoding pick_encoding(id_t id, size_t size) {
+        if (size < raw_below) return bitmap_encoding::raw;
+        bitmap_encoding e {bitmap_encoding::lz4};
+        for (auto const & r : encoding_rules) {
+            if (r.first.empty() || bitmap_paths[id].compare(0, r.first.size(), r.first) == 0) e = r.second;
+        }
+        return e;
+    }
+    bitmap_payload encode_bitmap(bitmap_encoding encoding, uint16_t width, uint16_t height) {
+        std::vector<uint8_t> & compressed {inflate_buf};
+        switch (encoding) {
+        case bitmap_encoding::lz4:
+        case bitmap_encoding::lz4hc: {
+            compressed.resize(lz4::compress_bound(pixel_buf.size()));
+            size_t const csize {encoding == bitmap_encoding::lz4hc
+                ? lz4::compress_hc(pixel_buf.data(), compressed.data(), pixel_buf.size())
+                : lz4::compress(pixel_buf.data(), compressed.data(), pixel_buf.size())};
+            return make_payload(compressed.data(), csize, bitmap::format::bgra8888, width, height, bitmap::codec::lz4);
+        }
+        case bitmap_encoding::zstd: {
+#ifdef NX_ZSTD
+            compressed.resize(ZSTD_compressBound(pixel_buf.size()));
+            size_t const csize {ZSTD_compress(compressed.data(), compressed.size(), pixel_buf.data(), pixel_buf.size(), 19)};
+            if (ZSTD_isError(csize)) throw std::runtime_error {"Failed to compress bitmap with zstd"};
+            return make_payload(compressed.data(), csize, bitmap::format::bgra8888, width, height, bitmap::codec::zstd);
+#else
+            throw std::runtime_error {"WzToNx was built without zstd support"};
+#endif
+        }
+        case bitmap_encoding::raw:
+            return make_payload(pixel_buf.data(), pixel_buf.size(), bitmap::format::bgra8888, width, height, bitmap::codec::raw);
+        }
+        throw std::runtime_error {"Unknown bitmap encoding"};
+    }
+    //BC1 keeps 1-bit alpha, so every pixel has to decode as opaque or transparent as it went in
+    void check_bc1(uint8_t const * blocks, uint16_t width, uint16_t height) {
+        bc1_check_buf.resize(static_cast<size_t>(width) * height * 4);
+        bcn::decompress_bc1(blocks, bc1_check_buf.data(), width, height);
+        for (size_t i {3}; i < bc1_check_buf.size(); i += 4) {
+            if (bc1_check_buf[i] != (pixel_buf[i] >= 128 ? 255 : 0)) throw std::runtime_error {"BC1 changed the alpha of a pixel"};
+        }
+    }
+    bitmap_payload convert_bitmap(id_t id, uint64_t offset) {
+        in::seek(offset);
+        uint16_t const width {static_cast<uint16_t>(in::read_cint())};
+        uint16_t const height {static_cast<uint16_t>(in::read_cint())};
+        int32_t format {in::read_cint()};
+        format += in::read<uint8_t>();
+        in::skip(4);
+        int32_t const size {in::read<int32_t>() - 1};
         in::skip(1);
-        deduce_key();
-        in::skip(2);
-        sub_property(img_node, p);
-        in::seek(p + size);
+        inflate_bitmap(reinterpret_cast<uint8_t const *>(in::offset), static_cast<size_t>(size), inflated_size(format, width, height));
+        expand_bitmap(format, width, height);
+        bitmap_alphas.push_back(compute_alpha(width, height));
+        bitmap_encoding const encoding {pick_encoding(id, pixel_buf.size())};
+        //Bitmaps picked to be stored raw are meant for zero copy access, so they skip BCn as well
+        if (bcn_output && encoding != bitmap_encoding::raw) {
+            //DXT3 and DXT5 canvases are BC2 and BC3 already, so they go through untouched
+            if (format == 1026) return make_payload(inflate_buf.data(), inflate_buf.size(), bitmap::format::bc2, width, height);
+            if (format == 2050) return make_payload(inflate_buf.data(), inflate_buf.size(), bitmap::format::bc3, width, height);
+            std::vector<uint8_t> & blocks {inflate_buf};
+            if (!(bitmap_alphas.back().flags & 2)) {
+                blocks.resize(bcn::length(width, height, 8));
+                bcn::compress_bc1(pixel_buf.data(), blocks.data(), width, height);
+                check_bc1(blocks.data(), width, height);
+                return make_payload(blocks.data(), blocks.size(), bitmap::format::bc1, width, height);
+            }
+            blocks.resize(bcn::length(width, height, 16));
+            bcn::compress_bc3(pixel_buf.data(), blocks.data(), width, height);
+            return make_payload(blocks.data(), blocks.size(), bitmap::format::bc3, width, height);
+        }
+        return encode_bitmap(encoding, width, height);
+    }
+    void add_bitmap(nx_writer & writer, id_t id) {
+        bitmap_payload const p {convert_bitmap(id, bitmaps[id])};
+        uint32_t const count {writer.bitmap_count()};
+        uint32_t const index {writer.add_bitmap(p.data, p.size, p.width, p.height, p.format, p.codec)};
+        bitmap_remap.push_back(index);
+        if (index == count) return;
+        bitmap_alphas.pop_back();
+        duplicate_bitmap_bytes += p.size + 4;
+    }
+    //The wave format after the Sound_DX8 header is encrypted in some files
+    //in which case its length doesn't agree with the cbSize field
+    audio_info parse_audio(char const * data, uint32_t duration) {
+        uint8_t const format_length {static_cast<uint8_t>(data[51])};
+        audio_info info {0, duration, 0, 0, audio_codec::unknown, 0, static_cast<uint16_t>(52 + format_length)};
+        if (format_length < 18) return info;
+        uint8_t format[0x100];
+        memcpy(format, data + 52, format_length);
+        if (18u + (format[16] | format[17] << 8) != format_length) {
+            for (uint8_t i {0}; i < format_length; ++i) format[i] ^= (*cur_key)[i];
+        }
+        uint16_t const tag {static_cast<uint16_t>(format[0] | format[1] << 8)};
+        info.codec = tag == 1 ? audio_codec::pcm : tag == 0x55 ? audio_codec::mp3 : audio_codec::unknown;
+        info.channels = static_cast<uint16_t>(format[2] | format[3] << 8);
+        info.sample_rate = static_cast<uint32_t>(format[4] | format[5] << 8 | format[6] << 16 | format[7] << 24);
+        info.bits_per_sample = static_cast<uint16_t>(format[14] | format[15] << 8);
+        return info;
+    }
+#ifdef WZTONX_MPG123
+    std::vector<uint8_t> pcm_buf {};
+    std::vector<char> pcm_payload {};
+    //Replaces the MP3 data with 16-bit PCM and the wave format with a plain WAVEFORMATEX,
+    //so even readers that only look at the Sound_DX8 header see a PCM sound
+    bool decode_audio(audio_payload & p, audio_info & info) {
+        mpg123_handle * const h {mpg123_new(nullptr, nullptr)};
+        if (!h) return false;
+        mpg123_open_feed(h);
+        mpg123_feed(h, reinterpret_cast<unsigned char const *>(p.data) + info.header_length, p.size - info.header_length);
+        pcm_buf.clear();
+        long rate {0};
+        int channels {0}, encoding {0};
+        unsigned char chunk[0x4000];
+        for (;;) {
+            size_t done {0};
+            int const r {mpg123_read(h, chunk, sizeof(chunk), &done)};
+            pcm_buf.insert(pcm_buf.end(), chunk, chunk + done);
+            if (r == MPG123_NEW_FORMAT) mpg123_getformat(h, &rate, &channels, &encoding);
+            else if (r != MPG123_OK) break;
+        }
+        mpg123_delete(h);
+        if (pcm_buf.empty() || !rate || encoding != MPG123_ENC_SIGNED_16) return false;
+        static uint8_t const subtype_pcm[16] {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+            0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+        uint32_t const size {static_cast<uint32_t>(52 + 18 + pcm_buf.size())};
+        pcm_payload.resize(size);
+        char * const d {pcm_payload.data()};
+        memcpy(d, p.data, 51);
+        memcpy(d + 17, subtype_pcm, 16);
+        d[51] = 18;
+        info.codec = audio_codec::pcm;
+        info.sample_rate = static_cast<uint32_t>(rate);
+        info.channels = static_cast<uint16_t>(channels);
+        info.bits_per_sample = 16;
+        info.header_length = 52 + 18;
+        uint16_t const block_align {static_cast<uint16_t>(channels * 2)};
+        uint32_t const byte_rate {info.sample_rate * block_align};
+        uint16_t const wave_format[9] {1, info.channels, static_cast<uint16_t>(info.sample_rate), static_cast<uint16_t>(info.sample_rate >> 16),
+            static_cast<uint16_t>(byte_rate), static_cast<uint16_t>(byte_rate >> 16), block_align, 16, 0};
+        memcpy(d + 52, wave_format, 18);
+        memcpy(d + 52 + 18, pcm_buf.data(), pcm_buf.size());
+        p = {d, size};
+        return true;
+    }
+#endif
+    void add_audio(nx_writer & writer, uint64_t offset, uint32_t size, uint32_t duration) {
+        audio_payload p {in::base + offset, size};
+        audio_info info {parse_audio(in::base + offset, duration)};
+#ifdef WZTONX_MPG123
+        if (info.codec == audio_codec::mp3 && duration < pcm_below && decode_audio(p, info)) ++decoded_audio;
+#endif
+        uint32_t const count {writer.audio_count()};
+        uint32_t const index {writer.add_audio(p.data, p.size)};
+        audio_remap.push_back(index);
+        audio_lengths.push_back(p.size);
+        if (index == count) audio_infos.push_back(info);
+        else duplicate_audio_bytes += p.size;
+    }
+    //Runs f over every string a few times and gives the best time per string in nanoseconds
+    template <typename F> double time_strings(std::vector<std::pair<size_t, size_t>> const & spans, F const & f, char8_t * out) {
+        double best {std::numeric_limits<double>::max()};
+        for (int run {0}; run < 5; ++run) {
+            size_t total {0};
+            auto const start = std::chrono::high_resolution_clock::now();
+            for (auto const & sp : spans) total += f(sp.first, sp.second, out);
+            auto const end = std::chrono::high_resolution_clock::now();
+            if (!total) throw std::runtime_error {"Nothing was decoded"};
+            best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / spans.size());
+        }
+        return best;
+    }
+    //Checks that both versions give the same output for every string before timing them
+    template <typename P, typename S> void compare_strings(std::vector<std::pair<size_t, size_t>> const & spans, char const * name,
+        P const & plain, S const & simd) {
+        std::vector<char8_t> out_plain(0x18000), out_simd(0x18000);
+        for (auto const & sp : spans) {
+            size_t const a {plain(sp.first, sp.second, out_plain.data())};
+            size_t const b {simd(sp.first, sp.second, out_simd.data())};
+            if (a != b || memcmp(out_plain.data(), out_simd.data(), a)) throw std::runtime_error {std::string {name} + " gave different output"};
+        }
+        double const p {time_strings(spans, plain, out_plain.data())};
+        double const v {time_strings(spans, simd, out_simd.data())};
+        std::cout << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(11) << p << std::setw(11) << v << std::setprecision(2) << std::setw(10) << p / v << 'x' << std::endl;
+    }
+    //Times each stage of decoding strings on generated names, the plain loops against the SSE2 ones
+    //Most names are short, like origin or delay, with the odd longer description among them
+    void bench_strings() {
+        mask_keys();
+        string_key const & key {string_keys[1]};
+        std::mt19937 engine {1};
+        auto const random = [&](uint32_t n) {
+            return static_cast<uint32_t>(engine() % n);
+        };
+        size_t const count {100000};
+        //Every string is stored plain and encrypted at the same offset, with its length alongside
+        std::vector<std::pair<size_t, size_t>> spans {};
+        std::vector<char8_t> narrow_plain {}, narrow_enc {};
+        std::vector<char16_t> ascii_plain {}, ascii_enc {}, hangul_plain {}, hangul_enc {};
+        for (size_t i {0}; i < count; ++i) {
+            size_t const length {random(5) ? 1 + random(24) : 25 + random(176)};
+            spans.emplace_back(ascii_plain.size(), length);
+            for (size_t j {0}; j < length; ++j) {
+                char16_t const c {static_cast<char16_t>(0x20 + random(0x5F))};
+                narrow_plain.push_back(static_cast<char8_t>(c));
+                narrow_enc.push_back(static_cast<char8_t>(c ^ key.narrow[j]));
+                ascii_plain.push_back(c);
+                ascii_enc.push_back(static_cast<char16_t>(c ^ (key.wide[j * 2] | key.wide[j * 2 + 1] << 8)));
+                char16_t const h {static_cast<char16_t>(!random(4) ? c : random(50) ? 0xAC00 + random(11172) :
+                    j + 1 < length ? 0xD83D : 0xFFFD)};
+                hangul_plain.push_back(h);
+                hangul_enc.push_back(static_cast<char16_t>(h ^ (key.wide[j * 2] | key.wide[j * 2 + 1] << 8)));
+                if (h == 0xD83D) {
+                    ++j;
+                    narrow_plain.push_back('x'), narrow_enc.push_back(static_cast<char8_t>('x' ^ key.narrow[j]));
+                    ascii_plain.push_back('x'), ascii_enc.push_back(static_cast<char16_t>('x' ^ (key.wide[j * 2] | key.wide[j * 2 + 1] << 8)));
+                    hangul_plain.push_back(0xDE00);
+                    hangul_enc.push_back(static_cast<char16_t>(0xDE00 ^ (key.wide[j * 2] | key.wide[j * 2 + 1] << 8)));
+                }
+            }
+        }
+#ifdef WZTONX_SSE2
+        char const * const simd_name {"SSE2 ns"};
+#else
+        char const * const simd_name {"Plain ns"};
+#endif
+        std::cout << std::left << std::setw(18) << "Stage" << std::right << std::setw(11) << "Plain ns"
+            << std::setw(11) << simd_name << std::setw(11) << "Speedup" << std::endl;
+        compare_strings(spans, "Decrypt bytes", [&](size_t o, size_t n, char8_t * out) {
+            decrypt_scalar(narrow_enc.data() + o, key.narrow, n, out);
+            return n;
+        }, [&](size_t o, size_t n, char8_t * out) {
+            decrypt(narrow_enc.data() + o, key.narrow, n, out);
+            return n;
+        });
+        compare_strings(spans, "Decrypt UTF-16", [&](size_t o, size_t n, char8_t * out) {
+            decrypt_scalar(ascii_enc.data() + o, key.wide, n * 2, out);
+            return n * 2;
+        }, [&](size_t o, size_t n, char8_t * out) {
+            decrypt(ascii_enc.data() + o, key.wide, n * 2, out);
+            return n * 2;
+        });
+        compare_strings(spans, "Transcode ASCII", [&](size_t o, size_t n, char8_t * out) {
+            return utf16_to_utf8_scalar(ascii_plain.data() + o, n, out);
+        }, [&](size_t o, size_t n, char8_t * out) {
+            return utf16_to_utf8(ascii_plain.data() + o, n, out);
+        });
+        compare_strings(spans, "Transcode Hangul", [&](size_t o, size_t n, char8_t * out) {
+            return utf16_to_utf8_scalar(hangul_plain.data() + o, n, out);
+        }, [&](size_t o, size_t n, char8_t * out) {
+            return utf16_to_utf8(hangul_plain.data() + o, n, out);
+        });
+        std::vector<char16_t> wbuf(0x8000);
+        compare_strings(spans, "Decode UTF-16", [&](size_t o, size_t n, char8_t * out) {
+            decrypt_scalar(hangul_enc.data() + o, key.wide, n * 2, wbuf.data());
+            return utf16_to_utf8_scalar(wbuf.data(), n, out);
+        }, [&](size_t o, size_t n, char8_t * out) {
+            decrypt(hangul_enc.data() + o, key.wide, n * 2, wbuf.data());
+            return utf16_to_utf8(wbuf.data(), n, out);
+        });
+        //The plain text doubles as a check that the keys were masked the way the files expect
+        std::vector<char8_t> check(256);
+        for (auto const & sp : spans) {
+            decrypt(narrow_enc.data() + sp.first, key.narrow, sp.second, check.data());
+            if (memcmp(check.data(), narrow_plain.data() + sp.first, sp.second)) throw std::runtime_error {"Decrypted bytes don't match"};
+            decrypt(hangul_enc.data() + sp.first, key.wide, sp.second * 2, wbuf.data());
+            if (memcmp(wbuf.data(), hangul_plain.data() + sp.first, sp.second * 2)) throw std::runtime_error {"Decrypted UTF-16 doesn't match"};
+        }
     }
     void wztonx(std::string filename) {
+        mask_keys();
         in::open(filename);
         filename.erase(filename.find_last_of('.')).append(".nx");
         uint32_t magic {in::read<uint32_t>()};
@@ -559,8 +1321,10 @@ namespace nl {
         std::cout << "Opened file" << std::endl;
         directory(0);
         std::cout << "Parsed directories" << std::endl;
-        for (auto & it : imgs) img(it.first, it.second);
+        parse_imgs();
         std::cout << "Parsed images" << std::endl;
+        if (reused_strings) std::cout << "Reused " << reused_strings << " strings referenced by offset instead of decoding "
+            << reused_string_bytes << " bytes again" << std::endl;
         for (auto const & n : nodes_to_sort) sort_nodes(n.first, n.second);
         find_uols(0);
         for (;;) {
@@ -570,52 +1334,122 @@ namespace nl {
         }
         for (auto & it : uols) uol_fail(it);
         std::cout << "Node cleanup finished" << std::endl;
-        size_t node_offset = 52;
-        node_offset += 0x10 - (node_offset & 0xf);
-        size_t string_table_offset = node_offset + nodes.size() * 20;
-        string_table_offset += 0x10 - (string_table_offset & 0xf);
-        size_t string_offset = string_table_offset + strings.size() * 8;
-        string_offset += 0x10 - (string_offset & 0xf);
-        size_t bitmap_table_offset = string_offset + strings.size() * 2;
-        for (auto const & s : strings) bitmap_table_offset += s.size;
-        bitmap_table_offset += 0x10 - (bitmap_table_offset & 0xf);
-        out::open(filename, bitmap_table_offset);
-        out::seek(0);
-        out::write<uint32_t>(0x34474B50);
-        out::write<uint32_t>(static_cast<uint32_t>(nodes.size()));
-        out::write<uint64_t>(node_offset);
-        out::write<uint32_t>(static_cast<uint32_t>(strings.size()));
-        out::write<uint64_t>(string_table_offset);
-        //No bitmap or audio support yet
-        out::write<uint32_t>(0);
-        out::write<uint64_t>(0);
-        out::write<uint32_t>(0);
-        out::write<uint64_t>(0);
+        nx_writer writer {filename};
+        if (front_coded_strings) writer.front_code_strings();
+        writer.pack_arrays();
+        writer.set_layout(node_layout);
         std::cout << "Opened output" << std::endl;
-        out::seek(node_offset);
-        out::write(nodes.data(), nodes.size() * 20);
-        std::cout << "Wrote nodes" << std::endl;
-        out::seek(string_table_offset);
-        size_t next_str {string_offset};
-        for (auto const & s : strings) {
-            out::write<uint64_t>(next_str);
-            next_str += s.size + 2;
-        }
-        out::seek(string_offset);
-        for (auto const & s : strings) {
-            out::write<uint16_t>(s.size);
-            out::write(s.data, s.size);
-        }
-        std::cout << "Wrote strings" << std::endl;
-        out::close();
+        bitmap_paths.resize(bitmaps.size());
+        if (std::any_of(encoding_rules.begin(), encoding_rules.end(), [](std::pair<std::string, bitmap_encoding> const & r) {
+            return !r.first.empty();
+        })) find_bitmap_paths(0, "");
+        for (id_t i {0}; i < bitmaps.size(); ++i) add_bitmap(writer, i);
+        std::cout << "Wrote bitmaps" << std::endl;
+        std::vector<uint32_t> sound_sizes(sounds.size());
+        for (auto const & n : nodes) if (n.data_type == node::type::audio) sound_sizes[n.data.audio.id] = n.data.audio.length;
+        for (size_t i {0}; i < sounds.size(); ++i) add_audio(writer, sounds[i], sound_sizes[i], sound_durations[i]);
+        if (decoded_audio) std::cout << "Decoded " << decoded_audio << " audio to PCM" << std::endl;
+        std::cout << "Wrote audio" << std::endl;
+        std::cout << "Deduplicated " << bitmaps.size() - writer.bitmap_count() << " bitmaps and "
+            << sounds.size() - writer.audio_count() << " audio, saving "
+            << duplicate_bitmap_bytes + duplicate_audio_bytes << " bytes" << std::endl;
+        writer.add_section(0x41544D42, static_cast<uint32_t>(bitmap_alphas.size()), bitmap_alphas.data(), bitmap_alphas.size() * sizeof(bitmap_alpha));
+        writer.add_section(0x4D445541, static_cast<uint32_t>(audio_infos.size()), audio_infos.data(), audio_infos.size() * sizeof(audio_info));
+        std::vector<uint32_t> string_remap {};
+        for (auto const & s : strings) string_remap.push_back(writer.add_string(s.data, s.size));
+        writer.add_nodes(static_cast<uint32_t>(nodes.size() - 1));
+        for (id_t i {0}; i < nodes.size(); ++i) {
+            node const & n {nodes[i]};
+            writer.set_name(i, string_remap[n.name]);
+            if (n.num) writer.set_children(i, n.children, n.num);
+            switch (n.data_type) {
+            case node::type::integer: writer.set_integer(i, n.data.integer); break;
+            case node::type::real: writer.set_real(i, n.data.real); break;
+            case node::type::string: writer.set_string(i, string_remap[n.data.string]); break;
+            case node::type::vector: writer.set_vector(i, n.data.vector[0], n.data.vector[1]); break;
+            case node::type::bitmap: writer.set_bitmap(i, bitmap_remap[n.data.bitmap.id], n.data.bitmap.width, n.data.bitmap.height); break;
+            case node::type::audio: writer.set_audio(i, audio_remap[n.data.audio.id], audio_lengths[n.data.audio.id]); break;
+            default: writer.set_none(i); break;
+            }
+        }
+        writer.finish();
+        std::cout << "Wrote nodes and strings" << std::endl;
         in::close();
         std::cout << "Done" << std::endl;
     }
 }
 int main(int argc, char ** argv) {
     std::chrono::high_resolution_clock::time_point a {std::chrono::high_resolution_clock::now()};
-    if (argc > 1) nl::wztonx(argv[1]);
-    else nl::wztonx("Data.wz");
+    std::string filename {"Data.wz"};
+    for (int i {1}; i < argc; ++i) {
+        std::string const arg {argv[i]};
+        //Stores bitmaps as BC1/BC3 blocks instead of LZ4 compressed BGRA
+        if (arg == "--bcn") nl::bcn_output = true;
+        //--codec <lz4|lz4hc|zstd|raw>[:<path prefix>] picks how BGRA bitmaps are compressed
+        //The last rule matching a bitmap's path wins, and a rule without a prefix matches everything
+        else if (arg == "--codec" && i + 1 < argc) {
+            std::string rule {argv[++i]};
+            size_t const colon {rule.find(':')};
+            std::string const prefix {colon == std::string::npos ? "" : rule.substr(colon + 1)};
+            rule = rule.substr(0, colon);
+            nl::bitmap_encoding e {};
+            if (rule == "lz4") e = nl::bitmap_encoding::lz4;
+            else if (rule == "lz4hc") e = nl::bitmap_encoding::lz4hc;
+            else if (rule == "zstd") e = nl::bitmap_encoding::zstd;
+            else if (rule == "raw") e = nl::bitmap_encoding::raw;
+            else {
+                std::cerr << "Unknown codec " << rule << std::endl;
+                return 1;
+            }
+            nl::encoding_rules.emplace_back(prefix, e);
+        }
+        //--raw-below <bytes> stores every BGRA bitmap smaller than that raw
+        else if (arg == "--raw-below" && i + 1 < argc) nl::raw_below = std::stoul(argv[++i]);
+        //--raw-list <file> stores the bitmaps under each path prefix listed in the file raw, one per line
+        else if (arg == "--raw-list" && i + 1 < argc) {
+            std::ifstream list {argv[++i]};
+            if (!list) {
+                std::cerr << "Failed to open " << argv[i] << std::endl;
+                return 1;
+            }
+            for (std::string line; std::getline(list, line);) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (!line.empty()) nl::encoding_rules.emplace_back(line, nl::bitmap_encoding::raw);
+            }
+        }
+        //--threads <n> parses imgs on that many threads, every core by default
+        else if (arg == "--threads" && i + 1 < argc) nl::thread_count = std::max<size_t>(std::stoul(argv[++i]), 1);
+        //--front-code stores the strings front coded, which only newer readers understand
+        else if (arg == "--front-code") nl::front_coded_strings = true;
+        //--bench-strings times decrypting and transcoding strings instead of converting anything
+        else if (arg == "--bench-strings") {
+            nl::bench_strings();
+            return 0;
+        }
+        //--layout <dfs|bfs|parse> picks the order of the nodes in the output, dfs keeping each img together
+        else if (arg == "--layout" && i + 1 < argc) {
+            std::string const layout {argv[++i]};
+            if (layout == "dfs") nl::node_layout = nl::nx_writer::layout::depth_first;
+            else if (layout == "bfs") nl::node_layout = nl::nx_writer::layout::breadth_first;
+            else if (layout == "parse") nl::node_layout = nl::nx_writer::layout::insertion;
+            else {
+                std::cerr << "Unknown layout " << layout << std::endl;
+                return 1;
+            }
+        }
+#ifdef WZTONX_MPG123
+        //--pcm-below <ms> decodes MP3 sounds shorter than that to PCM so they play without any decoding
+        else if (arg == "--pcm-below" && i + 1 < argc) nl::pcm_below = static_cast<uint32_t>(std::stoul(argv[++i]));
+#endif
+        else filename = arg;
+    }
+#ifdef WZTONX_MPG123
+    if (mpg123_init() != MPG123_OK) {
+        std::cerr << "Failed to initialize mpg123" << std::endl;
+        return 1;
+    }
+#endif
+    nl::wztonx(filename);
     std::chrono::high_resolution_clock::time_point b {std::chrono::high_resolution_clock::now()};
     std::cout << "Took " << std::chrono::duration_cast<std::chrono::milliseconds>(b - a).count() << " ms" << std::endl;
 }